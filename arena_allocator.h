@@ -0,0 +1,195 @@
+/*
+ * arena_allocator.h
+ *
+ * Region memory for containers which live and die together, e.g. the lists
+ * of one request. TArena hands out memory by bumping a pointer through
+ * blocks and gives all of it back at once when it is released or destroyed.
+ * TArenaAllocator plugs a TArena into a container.
+ */
+
+#ifndef ARENA_ALLOCATOR_H_
+#define ARENA_ALLOCATOR_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Not thread safe: an arena belongs to one thread at a time.
+class TArena {
+public:
+  explicit TArena(const size_t first_block_size = 64 * 1024)
+      : last_block(nullptr), current(nullptr), end(nullptr),
+        next_block_size(std::max(first_block_size, sizeof(Block) * 2)),
+        allocated_bytes(0), reserved_bytes(0) {
+  }
+
+  TArena(const TArena& other) = delete;
+
+  ~TArena() {
+    Release();
+  }
+
+  TArena& operator=(const TArena& other) = delete;
+
+  // alignment must be a power of 2. Throws std::bad_alloc.
+  void* Allocate(const size_t bytes, const size_t alignment) {
+    char* begin = AlignUp(current, alignment);
+    if (current == nullptr || begin > end || bytes > size_t(end - begin)) {
+      // The block would not fit in size_t.
+      if (bytes > size_t(-1) - sizeof(Block) - alignment) {
+        throw std::bad_alloc();
+      }
+      AddBlock(bytes + alignment);
+      begin = AlignUp(current, alignment);
+    }
+    current = begin + bytes;
+    allocated_bytes += bytes;
+    return begin;
+  }
+
+  // Gives all memory of the arena back at once. Objects in it are not
+  // destroyed.
+  void Release() {
+    while (last_block != nullptr) {
+      Block* const previous = last_block->previous;
+      ::operator delete(last_block);
+      last_block = previous;
+    }
+    current = end = nullptr;
+    allocated_bytes = reserved_bytes = 0;
+  }
+
+  // Memory handed out since the last Release.
+  size_t AllocatedBytes() const {
+    return allocated_bytes;
+  }
+
+  // Memory taken from the system since the last Release.
+  size_t ReservedBytes() const {
+    return reserved_bytes;
+  }
+
+private:
+  // Header of a block, the memory handed out follows it.
+  struct Block {
+    Block* previous;
+  };
+
+  // Blocks grow twice up to this size, so that big arenas take few blocks
+  // and small ones do not reserve much.
+  static const size_t kMaxBlockSize = 16 * 1024 * 1024;
+
+  static char* AlignUp(char* const ptr, const size_t alignment) {
+    return reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(ptr)
+        + alignment - 1) & ~(uintptr_t(alignment) - 1));
+  }
+
+  void AddBlock(const size_t min_bytes) {
+    const size_t block_size = std::max(next_block_size,
+        sizeof(Block) + min_bytes);
+    Block* const block = static_cast<Block*>(::operator new(block_size));
+    block->previous = last_block;
+    last_block = block;
+    current = reinterpret_cast<char*>(block + 1);
+    end = reinterpret_cast<char*>(block) + block_size;
+    reserved_bytes += block_size;
+    next_block_size = std::min(next_block_size * 2,
+        std::max(next_block_size, size_t(kMaxBlockSize)));
+  }
+
+  Block* last_block;
+  char* current;
+  char* end;
+  size_t next_block_size;
+  size_t allocated_bytes;
+  size_t reserved_bytes;
+};
+
+// Allocates from a TArena. deallocate does nothing: the memory goes back when
+// the arena is released, so the arena must outlive the containers which use
+// it. Containers may skip deallocate altogether, see deallocate_is_noop.
+template<typename T>
+class TArenaAllocator {
+public:
+  typedef T value_type;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef std::true_type deallocate_is_noop;
+
+  template<typename U>
+  struct rebind {
+    typedef TArenaAllocator<U> other;
+  };
+
+  explicit TArenaAllocator(TArena& arena)
+      : arena(&arena) {
+  }
+
+  template<typename U>
+  TArenaAllocator(const TArenaAllocator<U>& other)
+      : arena(other.arena) {
+  }
+
+  pointer address(reference r) const {
+    return &r;
+  }
+
+  const_pointer address(const_reference r) const {
+    return &r;
+  }
+
+  pointer allocate(size_type n) {
+    if (n > max_size()) {
+      throw std::bad_alloc();
+    }
+    return static_cast<pointer>(arena->Allocate(n * sizeof(value_type),
+        alignof(value_type)));
+  }
+
+  void deallocate(pointer, size_type) {
+  }
+
+  template<typename ... Args>
+  void construct(pointer p, Args&& ... args) {
+    new (p) T(std::forward<Args>(args)...);
+  }
+
+  void destroy(pointer p) {
+    p->~T();
+  }
+
+  size_type max_size() const noexcept {
+    return size_t(-1) / sizeof(value_type);
+  }
+
+  TArena& GetArena() const {
+    return *arena;
+  }
+
+private:
+  template<typename U>
+  friend class TArenaAllocator;
+
+  TArena* arena;
+};
+
+template<typename T, typename U>
+inline bool operator==(const TArenaAllocator<T>& x,
+                       const TArenaAllocator<U>& y) {
+  return &x.GetArena() == &y.GetArena();
+}
+
+template<typename T, typename U>
+inline bool operator!=(const TArenaAllocator<T>& x,
+                       const TArenaAllocator<U>& y) {
+  return !(x == y);
+}
+
+#endif /* ARENA_ALLOCATOR_H_ */
@@ -0,0 +1,410 @@
+/*
+ * list_benchmark.cpp
+ *
+ * TList against std::list, each with TFastAllocator and with std::allocator.
+ * Every list operation is timed for several element sizes and list lengths,
+ * the results are printed one per line as CSV (default) or as a JSON array.
+ * Built as C++17, it also times both lists over TFastMemoryResource.
+ *
+ * Build:
+ *   cmake -S .. -B build && cmake --build build --target list_benchmark
+ * Usage:
+ *   ./list_benchmark [--json] [length...]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "fast_allocator.h"
+#include "lst.h"
+#if __cplusplus >= 201703L
+#include "fast_memory_resource.h"
+#endif
+
+namespace {
+
+// Lists of every length are rebuilt and timed until this many elements are
+// processed, so that short lists are not lost in the timer resolution.
+const size_t kMinElementsPerOperation = 1000000;
+
+// Element of Size bytes ordered by its key.
+template<size_t Size>
+struct Element {
+  int key;
+  char payload[Size - sizeof(int)];
+
+  Element(const int key = 0)
+      : key(key) {
+  }
+
+  bool operator<(const Element& other) const {
+    return key < other.key;
+  }
+
+  bool operator==(const Element& other) const {
+    return key == other.key;
+  }
+};
+
+template<>
+struct Element<sizeof(int)> {
+  int key;
+
+  Element(const int key = 0)
+      : key(key) {
+  }
+
+  bool operator<(const Element& other) const {
+    return key < other.key;
+  }
+
+  bool operator==(const Element& other) const {
+    return key == other.key;
+  }
+};
+
+struct Result {
+  std::string container;
+  std::string allocator;
+  size_t element_size;
+  size_t length;
+  std::string operation;
+  double ns_per_element;
+};
+
+class Timer {
+public:
+  void Start() {
+    start = std::chrono::steady_clock::now();
+  }
+
+  void Stop() {
+    elapsed += std::chrono::steady_clock::now() - start;
+  }
+
+  double Nanoseconds() const {
+    return elapsed.count();
+  }
+
+private:
+  std::chrono::steady_clock::time_point start;
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::duration<double, std::nano>::zero();
+};
+
+// Keys 0..length-1 in random order.
+std::vector<int> RandomKeys(const size_t length) {
+  std::vector<int> keys(length);
+  for (size_t i = 0; i != length; ++i) {
+    keys[i] = static_cast<int>(i);
+  }
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(42));
+  return keys;
+}
+
+template<typename List>
+void Fill(List& list, const std::vector<int>& keys) {
+  for (auto key : keys) {
+    list.emplace_back(key);
+  }
+}
+
+template<typename T, typename Allocator>
+void SortByPointers(TList<T, Allocator>& list) {
+  list.sort_by_pointers();
+}
+
+// std::list has no pointer array sort, its rows time sort() to compare with.
+template<typename T, typename Allocator>
+void SortByPointers(std::list<T, Allocator>& list) {
+  list.sort();
+}
+
+// Times one operation over lists of the given length. Operation takes a
+// prepared list and the timer, and starts and stops the timer around the part
+// to be measured.
+template<typename List, typename Operation>
+double Measure(const size_t length, Operation operation) {
+  const std::vector<int> keys = RandomKeys(length);
+  const size_t rounds = std::max<size_t>(1,
+      kMinElementsPerOperation / std::max<size_t>(length, 1));
+  Timer timer;
+  for (size_t round = 0; round != rounds; ++round) {
+    operation(keys, timer);
+  }
+  return timer.Nanoseconds() / (rounds * std::max<size_t>(length, 1));
+}
+
+template<typename List>
+void RunOperations(const char* container,
+                   const char* allocator,
+                   const size_t length,
+                   std::vector<Result>& results) {
+  typedef typename List::value_type Value;
+  auto report = [&](const char* operation, const double ns_per_element) {
+    results.push_back(Result { container, allocator, sizeof(Value), length,
+        operation, ns_per_element });
+  };
+
+  report("push_back", Measure<List>(length,
+      [](const std::vector<int>& keys, Timer& timer) {
+        List list;
+        timer.Start();
+        for (auto key : keys) {
+          list.push_back(Value(key));
+        }
+        timer.Stop();
+      }));
+
+  report("push_front", Measure<List>(length,
+      [](const std::vector<int>& keys, Timer& timer) {
+        List list;
+        timer.Start();
+        for (auto key : keys) {
+          list.push_front(Value(key));
+        }
+        timer.Stop();
+      }));
+
+  report("emplace_back", Measure<List>(length,
+      [](const std::vector<int>& keys, Timer& timer) {
+        List list;
+        timer.Start();
+        for (auto key : keys) {
+          list.emplace_back(key);
+        }
+        timer.Stop();
+      }));
+
+  report("emplace_front", Measure<List>(length,
+      [](const std::vector<int>& keys, Timer& timer) {
+        List list;
+        timer.Start();
+        for (auto key : keys) {
+          list.emplace_front(key);
+        }
+        timer.Stop();
+      }));
+
+  report("insert_middle", Measure<List>(length,
+      [](const std::vector<int>& keys, Timer& timer) {
+        List list;
+        list.emplace_back(0);
+        list.emplace_back(0);
+        const auto middle = std::next(list.begin());
+        timer.Start();
+        for (auto key : keys) {
+          list.insert(middle, Value(key));
+        }
+        timer.Stop();
+      }));
+
+  report("erase", Measure<List>(length,
+      [](const std::vector<int>& keys, Timer& timer) {
+        List list;
+        Fill(list, keys);
+        timer.Start();
+        for (auto iter = list.begin(); iter != list.end();) {
+          iter = list.erase(iter);
+          if (iter != list.end()) {
+            ++iter;
+          }
+        }
+        list.clear();
+        timer.Stop();
+      }));
+
+  report("splice", Measure<List>(length,
+      [](const std::vector<int>& keys, Timer& timer) {
+        List from;
+        List to;
+        Fill(from, keys);
+        timer.Start();
+        while (!from.empty()) {
+          to.splice(to.begin(), from, from.begin(), std::next(from.begin()));
+        }
+        timer.Stop();
+      }));
+
+  report("sort", Measure<List>(length,
+      [](const std::vector<int>& keys, Timer& timer) {
+        List list;
+        Fill(list, keys);
+        timer.Start();
+        list.sort();
+        timer.Stop();
+      }));
+
+  report("sort_by_pointers", Measure<List>(length,
+      [](const std::vector<int>& keys, Timer& timer) {
+        List list;
+        Fill(list, keys);
+        timer.Start();
+        SortByPointers(list);
+        timer.Stop();
+      }));
+
+  // Sorted but for every 100th key.
+  report("sort_nearly_sorted", Measure<List>(length,
+      [](const std::vector<int>& keys, Timer& timer) {
+        List list;
+        for (size_t i = 0; i != keys.size(); ++i) {
+          list.emplace_back(i % 100 == 0 ? keys[i] : static_cast<int>(i));
+        }
+        timer.Start();
+        list.sort();
+        timer.Stop();
+      }));
+
+  report("merge", Measure<List>(length,
+      [](const std::vector<int>& keys, Timer& timer) {
+        List list;
+        List other;
+        for (size_t i = 0; i != keys.size(); ++i) {
+          (i % 2 == 0 ? list : other).emplace_back(static_cast<int>(i));
+        }
+        timer.Start();
+        list.merge(other);
+        timer.Stop();
+      }));
+
+  report("unique", Measure<List>(length,
+      [](const std::vector<int>& keys, Timer& timer) {
+        List list;
+        for (size_t i = 0; i != keys.size(); ++i) {
+          list.emplace_back(static_cast<int>(i / 2));
+        }
+        timer.Start();
+        list.unique();
+        timer.Stop();
+      }));
+
+  report("copy", Measure<List>(length,
+      [](const std::vector<int>& keys, Timer& timer) {
+        List list;
+        Fill(list, keys);
+        timer.Start();
+        List copy(list);
+        timer.Stop();
+      }));
+
+  report("assign", Measure<List>(length,
+      [](const std::vector<int>& keys, Timer& timer) {
+        List list;
+        Fill(list, keys);
+        List target;
+        for (size_t i = 0; i != keys.size() / 2; ++i) {
+          target.emplace_back(0);
+        }
+        timer.Start();
+        target = list;
+        timer.Stop();
+      }));
+
+  report("traversal", Measure<List>(length,
+      [](const std::vector<int>& keys, Timer& timer) {
+        List list;
+        Fill(list, keys);
+        long long sum = 0;
+        timer.Start();
+        for (const auto& value : list) {
+          sum += value.key;
+        }
+        timer.Stop();
+        if (sum != static_cast<long long>(keys.size())
+            * (static_cast<long long>(keys.size()) - 1) / 2) {
+          std::abort();
+        }
+      }));
+}
+
+template<size_t ElementSize>
+void RunElementSize(const std::vector<size_t>& lengths,
+                    std::vector<Result>& results) {
+  typedef Element<ElementSize> Value;
+  for (auto length : lengths) {
+    RunOperations<TList<Value, TFastAllocator<Value>>>("TList",
+        "TFastAllocator", length, results);
+    RunOperations<TList<Value, std::allocator<Value>>>("TList",
+        "std::allocator", length, results);
+    RunOperations<std::list<Value, TFastAllocator<Value>>>("std::list",
+        "TFastAllocator", length, results);
+    RunOperations<std::list<Value, std::allocator<Value>>>("std::list",
+        "std::allocator", length, results);
+#if __cplusplus >= 201703L
+    // The lists take the default resource, which main sets.
+    RunOperations<TPmrList<Value>>("TList", "TFastMemoryResource", length,
+        results);
+    RunOperations<std::pmr::list<Value>>("std::list", "TFastMemoryResource",
+        length, results);
+#endif
+  }
+}
+
+void PrintCsv(const std::vector<Result>& results) {
+  std::cout << "container,allocator,element_size,length,operation,"
+      "ns_per_element" << std::endl;
+  for (const auto& result : results) {
+    std::cout << result.container << "," << result.allocator << ","
+        << result.element_size << "," << result.length << ","
+        << result.operation << "," << result.ns_per_element << std::endl;
+  }
+}
+
+void PrintJson(const std::vector<Result>& results) {
+  std::cout << "[" << std::endl;
+  for (size_t i = 0; i != results.size(); ++i) {
+    const Result& result = results[i];
+    std::cout << "  {\"container\": \"" << result.container
+        << "\", \"allocator\": \"" << result.allocator
+        << "\", \"element_size\": " << result.element_size
+        << ", \"length\": " << result.length << ", \"operation\": \""
+        << result.operation << "\", \"ns_per_element\": "
+        << result.ns_per_element << "}"
+        << (i + 1 != results.size() ? "," : "") << std::endl;
+  }
+  std::cout << "]" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  bool json = false;
+  std::vector<size_t> lengths;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--json") == 0) {
+      json = true;
+    } else {
+      lengths.push_back(std::strtoul(argv[i], nullptr, 10));
+    }
+  }
+  if (lengths.empty()) {
+    lengths = { 100, 10000, 1000000 };
+  }
+
+#if __cplusplus >= 201703L
+  TFastMemoryResource resource;
+  std::pmr::set_default_resource(&resource);
+#endif
+
+  std::vector<Result> results;
+  RunElementSize<4>(lengths, results);
+  RunElementSize<16>(lengths, results);
+  RunElementSize<64>(lengths, results);
+
+  if (json) {
+    PrintJson(results);
+  } else {
+    PrintCsv(results);
+  }
+  return 0;
+}
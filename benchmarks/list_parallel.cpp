@@ -0,0 +1,153 @@
+/*
+ * list_parallel.cpp
+ *
+ * Parallel algorithms of list_algorithms.h and TList::parallel_sort against
+ * the sequential ListIterator loop and TList::sort, for 1..N threads. The
+ * parallel times include cutting the list into chunks, the sort times include
+ * filling the list with new random keys.
+ *
+ * Build:
+ *   g++ -O2 -std=c++11 -pthread -DFAST_ALLOCATOR_THREAD_SAFE -I.. \
+ *       list_parallel.cpp -o list_parallel
+ * Usage:
+ *   ./list_parallel [nodes_count] [max_threads]
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <thread>
+
+#include "fast_allocator.h"
+#include "list_algorithms.h"
+#include "lst.h"
+#include "thread_pool.h"
+
+namespace {
+
+const size_t kRounds = 5;
+
+typedef TList<double, TFastAllocator<double>> List;
+
+// Keeps the results from being optimized away.
+volatile double checksum;
+
+// Some work per element, so that the scans are not only memory bound.
+double Weight(const double value) {
+  return std::sqrt(value) * std::log1p(value);
+}
+
+// Best of kRounds runs of operation, in milliseconds.
+template<typename Operation>
+double Measure(Operation operation) {
+  double best = 0;
+  for (size_t round = 0; round != kRounds; ++round) {
+    const auto start = std::chrono::steady_clock::now();
+    operation();
+    const std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    if (round == 0 || elapsed.count() < best) {
+      best = elapsed.count();
+    }
+  }
+  return best;
+}
+
+void Report(const char* operation,
+            const size_t threads_count,
+            const double milliseconds,
+            const double sequential_milliseconds) {
+  std::cout << operation << "\tthreads=" << threads_count << "\tms="
+      << milliseconds << "\tspeedup=" << sequential_milliseconds / milliseconds
+      << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  size_t nodes_count = 4000000;
+  size_t max_threads = std::thread::hardware_concurrency();
+  if (argc > 1) {
+    nodes_count = std::strtoul(argv[1], nullptr, 10);
+  }
+  if (argc > 2) {
+    max_threads = std::strtoul(argv[2], nullptr, 10);
+  }
+  if (max_threads == 0) {
+    max_threads = 1;
+  }
+
+  List list;
+  std::mt19937 random(42);
+  for (size_t i = 0; i != nodes_count; ++i) {
+    list.push_back(random() % 1000000);
+  }
+
+  const double for_each_ms = Measure([&list] {
+    for (auto& value : list) {
+      value = Weight(value) + 1;
+    }
+  });
+  const double transform_reduce_ms = Measure([&list] {
+    double sum = 0;
+    for (auto value : list) {
+      sum += Weight(value);
+    }
+    checksum = sum;
+  });
+  const double count_if_ms = Measure([&list] {
+    size_t count = 0;
+    for (auto value : list) {
+      count += Weight(value) > 100 ? 1 : 0;
+    }
+    checksum = count;
+  });
+  Report("for_each", 1, for_each_ms, for_each_ms);
+  Report("transform_reduce", 1, transform_reduce_ms, transform_reduce_ms);
+  Report("count_if", 1, count_if_ms, count_if_ms);
+  for (size_t threads_count = 2; threads_count <= max_threads;
+      ++threads_count) {
+    // The calling thread works too.
+    TThreadPool pool(threads_count - 1);
+    Report("for_each", threads_count, Measure([&list, &pool] {
+      parallel_for_each(pool, list, [](double& value) {
+        value = Weight(value) + 1;
+      });
+    }), for_each_ms);
+    Report("transform_reduce", threads_count, Measure([&list, &pool] {
+      checksum = parallel_transform_reduce(pool, list, 0.0,
+          [](const double x, const double y) {
+            return x + y;
+          }, Weight);
+    }), transform_reduce_ms);
+    Report("count_if", threads_count, Measure([&list, &pool] {
+      checksum = parallel_count_if(pool, list, [](const double value) {
+        return Weight(value) > 100;
+      });
+    }), count_if_ms);
+  }
+
+  // Sorting scatters the nodes, so it goes after the scans. All timed sorts
+  // start from a list scattered by an earlier one.
+  list.sort();
+  const double sort_ms = Measure([&list, &random] {
+    for (auto& value : list) {
+      value = random();
+    }
+    list.sort();
+  });
+  Report("sort", 1, sort_ms, sort_ms);
+  for (size_t threads_count = 2; threads_count <= max_threads;
+      ++threads_count) {
+    TThreadPool pool(threads_count - 1);
+    Report("sort", threads_count, Measure([&list, &pool, &random] {
+      for (auto& value : list) {
+        value = random();
+      }
+      list.parallel_sort(pool);
+    }), sort_ms);
+  }
+  return 0;
+}
@@ -0,0 +1,88 @@
+/*
+ * thread_scaling.cpp
+ *
+ * Multi-threaded allocate/deallocate benchmark for TFastAllocator.
+ * Every thread repeatedly fills a TList with kListLength nodes and clears it.
+ * Prints total and per-thread throughput for 1..N threads.
+ *
+ * Build:
+ *   g++ -O2 -std=c++11 -pthread -DFAST_ALLOCATOR_THREAD_SAFE -I.. \
+ *       thread_scaling.cpp -o thread_scaling
+ * Usage:
+ *   ./thread_scaling [max_threads]
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "fast_allocator.h"
+#include "lst.h"
+
+namespace {
+
+const size_t kListLength = 1000;
+const size_t kRounds = 2000;
+
+template<typename Allocator>
+void Worker() {
+  TList<int, Allocator> list;
+  for (size_t round = 0; round != kRounds; ++round) {
+    for (size_t i = 0; i != kListLength; ++i) {
+      list.push_back(static_cast<int>(i));
+    }
+    list.clear();
+  }
+}
+
+// Returns allocations (and deallocations) per second over all threads.
+template<typename Allocator>
+double Run(const size_t threads_count) {
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i != threads_count; ++i) {
+    threads.emplace_back(Worker<Allocator>);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return threads_count * kRounds * kListLength / elapsed.count();
+}
+
+template<typename Allocator>
+void Report(const char* name, const size_t max_threads) {
+  double single_thread = 0;
+  for (size_t threads_count = 1; threads_count <= max_threads;
+      ++threads_count) {
+    const double ops = Run<Allocator>(threads_count);
+    if (threads_count == 1) {
+      single_thread = ops;
+    }
+    std::cout << name << "\tthreads=" << threads_count << "\tMops/s="
+        << ops / 1e6 << "\tper_thread=" << ops / threads_count / 1e6
+        << "\tspeedup=" << ops / single_thread << std::endl;
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  size_t max_threads = std::thread::hardware_concurrency();
+  if (argc > 1) {
+    max_threads = std::strtoul(argv[1], nullptr, 10);
+  }
+  if (max_threads == 0) {
+    max_threads = 1;
+  }
+
+  Report<TFastAllocator<int>>("TFastAllocator", max_threads);
+  Report<TCacheAlignedAllocator<int>>("TCacheAlignedAllocator", max_threads);
+  Report<std::allocator<int>>("std::allocator", max_threads);
+  return 0;
+}
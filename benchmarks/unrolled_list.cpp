@@ -0,0 +1,82 @@
+/*
+ * unrolled_list.cpp
+ *
+ * Scan time and memory per element of TUnrolledList and TForwardList against
+ * TList, all on TFastAllocator. The memory is what the pools of TFastAllocator hand out for
+ * the nodes, read from FixedAllocatorInstancesOwner::GetStats.
+ *
+ * Build:
+ *   g++ -O2 -std=c++11 -I.. unrolled_list.cpp -o unrolled_list
+ * Usage:
+ *   ./unrolled_list [elements_count]
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+#include "fast_allocator.h"
+#include "forward_list.h"
+#include "lst.h"
+#include "unrolled_list.h"
+
+namespace {
+
+const size_t kRounds = 10;
+
+// Keeps the scans from being optimized away.
+volatile unsigned checksum;
+
+size_t InUseBytes() {
+  size_t bytes = 0;
+  for (const auto& size_class :
+      FixedAllocatorInstancesOwner::GetStats().size_classes) {
+    bytes += size_class.in_use_bytes;
+  }
+  return bytes;
+}
+
+// Prints nanoseconds per scanned element and bytes of nodes per element.
+template<typename List>
+void Measure(const char* name, const size_t elements_count) {
+  const size_t bytes_before = InUseBytes();
+  List list;
+  std::mt19937 random(42);
+  for (size_t i = 0; i != elements_count; ++i) {
+    list.push_back(random());
+  }
+  const double bytes_per_element =
+      double(InUseBytes() - bytes_before) / elements_count;
+
+  unsigned sum = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t round = 0; round != kRounds; ++round) {
+    for (auto value : list) {
+      sum += value;
+    }
+  }
+  const std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  checksum = sum;
+  std::cout << name << "\t" << elapsed.count() / (kRounds * elements_count)
+      << "\t" << bytes_per_element << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  size_t elements_count = 4000000;
+  if (argc > 1) {
+    elements_count = std::strtoul(argv[1], nullptr, 10);
+  }
+
+  std::cout << "container\tns_per_element\tbytes_per_element" << std::endl;
+  Measure<TList<unsigned, TFastAllocator<unsigned>>>("TList",
+      elements_count);
+  Measure<TForwardList<unsigned>>("TForwardList", elements_count);
+  Measure<TUnrolledList<unsigned>>("TUnrolledList", elements_count);
+  Measure<TUnrolledList<unsigned, TFastAllocator<unsigned>, 64>>(
+      "TUnrolledList<64>", elements_count);
+  return 0;
+}
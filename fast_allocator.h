@@ -1,196 +1,2191 @@
-/*
- * fast_allocator.h
- *
- *  Created on: 4 . 2016 .
- *      Author: user
- */
-
-#ifndef FAST_ALLOCATOR_H_
-#define FAST_ALLOCATOR_H_
-
-#include <cstddef>
-#include <cstdint>
-#include <algorithm>
-#include <iostream>
-
-class FixedAllocatorBase {
-  template<typename T>
-  friend class TFastAllocator;
-
-protected:
-  virtual ~FixedAllocatorBase() {
-  }
-  virtual void* GiveChunk() = 0;
-  virtual void ReleaseChunk(void* chunk_to_release) = 0;
-};
-
-template<size_t ChunkSize = 20>
-class FixedAllocator : FixedAllocatorBase {
-  friend class FixedAllocatorInstancesOwner;
-
-private:
-  struct Chunk {
-    Chunk* next;
-    char data[ChunkSize - sizeof(Chunk*)];
-
-    Chunk()
-        : next(nullptr) {
-    }
-
-    Chunk(Chunk* const next)
-        : next(next) {
-    }
-  };
-
-  FixedAllocator(const size_t chunks_in_one_pool)
-      : free_head(nullptr), chunks_in_one_pool(chunks_in_one_pool) {
-  }
-
-  FixedAllocator(const FixedAllocator& other) = delete;
-
-  ~FixedAllocator() {
-  }
-
-  FixedAllocator& operator=(const FixedAllocator& other) = delete;
-
-  void AddNewPool() {
-    chunks_pools.emplace_back(chunks_in_one_pool);
-    auto& new_chunks = chunks_pools.back();
-    free_head = &new_chunks.front();
-    for (size_t new_chunk_index = 0;
-        new_chunk_index != new_chunks.size() - 1; ++new_chunk_index) {
-      new_chunks[new_chunk_index].next = &new_chunks[new_chunk_index + 1];
-    }
-    new_chunks.back().next = nullptr;
-  }
-
-  virtual void* GiveChunk() {
-    if (free_head == nullptr) {
-      // Out of free chunks.
-      AddNewPool();
-    }
-
-    auto tmp = free_head->next;
-    free_head->~Chunk();
-    void* new_memory_ptr = static_cast<void*>(free_head);
-    free_head = tmp;
-
-    return new_memory_ptr;
-  }
-
-  virtual void ReleaseChunk(void* chunk_to_release) {
-    Chunk* next_of_new_free_head = free_head;
-    free_head = static_cast<Chunk*>(chunk_to_release);
-    new (free_head) Chunk();
-    free_head->next = next_of_new_free_head;
-  }
-
-  std::vector<std::vector<Chunk>> chunks_pools;
-  Chunk* free_head;
-  const size_t chunks_in_one_pool;
-};
-
-class FixedAllocatorInstancesOwner {
-  template<typename T>
-  friend class TFastAllocator;
-
-private:
-  static FixedAllocatorBase* GetInstance(const size_t chunk_size) {
-    static FixedAllocator<12> twelve(100000);
-    static FixedAllocator<16> sixteen(100000);
-    static FixedAllocator<20> twenty(100000);
-    static FixedAllocator<24> twenty_four(100000);
-    switch (chunk_size) {
-    case 12:
-      return &twelve;
-    case 16:
-      return &sixteen;
-    case 20:
-      return &twenty;
-    case 24:
-      return &twenty_four;
-    default:
-      return nullptr;
-    }
-  }
-};
-
-template<typename T>
-class TFastAllocator {
-public:
-  typedef T value_type;
-  typedef size_t size_type;
-  typedef ptrdiff_t difference_type;
-  typedef T* pointer;
-  typedef const T* const_pointer;
-  typedef T& reference;
-  typedef const T& const_reference;
-
-  template<typename U>
-  struct rebind {
-    typedef TFastAllocator<U> other;
-  };
-
-  TFastAllocator() {
-  }
-
-  template<typename U>
-  TFastAllocator(const TFastAllocator<U>& other) {
-  }
-
-  pointer address(reference r) const {
-    std::cout << "address: " << &r << std::endl;
-    return &r;
-  }
-
-  const_pointer address(const_reference r) const {
-    std::cout << "const_address: " << &r << std::endl;
-    return &r;
-  }
-
-  pointer allocate(size_type n) {
-    const size_t bytes_to_allocate = n * sizeof(value_type);
-//    std::cout << "allocate: " << n << "objects " << bytes_to_allocate
-//        << " bytes" << std::endl;
-    auto fixed_allocator = FixedAllocatorInstancesOwner::GetInstance(
-        bytes_to_allocate);
-    if (fixed_allocator == nullptr) {
-      // There is no fixed allocator with ChunkSize equal to bytes_to_allocate
-      return static_cast<pointer>(static_cast<void*>(new char[bytes_to_allocate]));
-    }
-
-    void* chunk_pointer = fixed_allocator->GiveChunk();
-    return static_cast<pointer>(chunk_pointer);
-  }
-
-  void deallocate(pointer p, size_type n) {
-    const size_t bytes_to_deallocate = n * sizeof(value_type);
-//    std::cout << "deallocate: " << n << "objects " << bytes_to_deallocate
-//        << " bytes" << std::endl;
-    void* raw_pointer = static_cast<void*>(p);
-    auto fixed_allocator = FixedAllocatorInstancesOwner::GetInstance(
-        bytes_to_deallocate);
-    if (fixed_allocator == nullptr) {
-      delete static_cast<char*>(raw_pointer);
-    } else {
-      fixed_allocator->ReleaseChunk(raw_pointer);
-    }
-  }
-
-  template<typename ... Args>
-  void construct(pointer p, Args&& ... args) {
-//    std::cout << "args-construct: " << p << std::endl;
-    new (p) T(std::forward<Args>(args)...);
-  }
-
-  void destroy(pointer p) {
-//    std::cout << "destroy: " << p << std::endl;
-    p->~T();
-  }
-
-  size_type max_size() const noexcept {
-    return size_t(-1) / sizeof(value_type);
-  }
-};
-
-#endif /* FAST_ALLOCATOR_H_ */
+/*
+ * fast_allocator.h
+ *
+ *  Created on: 4 . 2016 .
+ *      Author: user
+ */
+
+#ifndef FAST_ALLOCATOR_H_
+#define FAST_ALLOCATOR_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#ifdef __linux__
+#include <cstdio>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <malloc.h>
+#else
+#include <stdlib.h>
+#endif
+
+#ifdef FAST_ALLOCATOR_TRACE
+#include <ostream>
+#endif
+
+// Define FAST_ALLOCATOR_THREAD_SAFE to share TFastAllocator between threads.
+// Every thread then allocates from its own spans of the pools and takes whole
+// spans from the shared pool, so GiveChunk and ReleaseChunk take no locks
+// unless a span runs out or becomes free. A chunk released by another thread
+// is queued to the owner of its span without locks.
+#ifdef FAST_ALLOCATOR_THREAD_SAFE
+#define FAST_ALLOCATOR_THREAD_LOCAL thread_local
+typedef std::mutex FixedAllocatorMutex;
+#else
+#define FAST_ALLOCATOR_THREAD_LOCAL
+struct FixedAllocatorMutex {
+  void lock() {
+  }
+  void unlock() {
+  }
+};
+#endif
+
+// Decides how many chunks each new pool of a FixedAllocator gets: the first
+// pool gets first_pool_chunks, every next one growth_factor times more, but
+// not more than max_pool_chunks (0 means no limit).
+struct FixedAllocatorGrowthPolicy {
+  size_t first_pool_chunks;
+  size_t growth_factor;
+  size_t max_pool_chunks;
+
+  // All pools of the same size.
+  static FixedAllocatorGrowthPolicy Fixed(const size_t chunks_in_one_pool) {
+    return FixedAllocatorGrowthPolicy { chunks_in_one_pool, 1, 0 };
+  }
+
+  static FixedAllocatorGrowthPolicy Geometric(const size_t first_pool_chunks,
+                                              const size_t growth_factor) {
+    return FixedAllocatorGrowthPolicy { first_pool_chunks, growth_factor, 0 };
+  }
+
+  // Geometric growth which stops at max_pool_chunks.
+  static FixedAllocatorGrowthPolicy Capped(const size_t first_pool_chunks,
+                                           const size_t growth_factor,
+                                           const size_t max_pool_chunks) {
+    return FixedAllocatorGrowthPolicy { first_pool_chunks, growth_factor,
+        max_pool_chunks };
+  }
+
+  size_t ChunksInPool(const size_t pool_index) const {
+    size_t chunks = std::max<size_t>(first_pool_chunks, 1);
+    for (size_t i = 0; i != pool_index; ++i) {
+      if (max_pool_chunks != 0 && chunks >= max_pool_chunks) {
+        break;
+      }
+      if (chunks > size_t(-1) / std::max<size_t>(growth_factor, 1)) {
+        break;
+      }
+      chunks *= std::max<size_t>(growth_factor, 1);
+    }
+    return max_pool_chunks != 0 ? std::min(chunks, max_pool_chunks) : chunks;
+  }
+};
+
+// Where pools of a FixedAllocator take their memory from. Backends other than
+// kHeap are available on Linux only; a backend which is not available falls
+// back to the next one in the order kHugeTlb, kTransparentHugePages, kMmap,
+// kHeap.
+enum class FixedAllocatorBackend {
+  // Global operator new.
+  kHeap,
+  // Anonymous mmap.
+  kMmap,
+  // Anonymous mmap aligned to huge pages and marked with MADV_HUGEPAGE, so
+  // that the kernel backs it with transparent huge pages when it can.
+  kTransparentHugePages,
+  // Anonymous mmap with MAP_HUGETLB, served from the huge pages reserved in
+  // /proc/sys/vm/nr_hugepages.
+  kHugeTlb
+};
+
+// NUMA nodes of the machine. Linux only, through the getcpu and mbind system
+// calls, so libnuma is not needed. Other systems and single-node machines have
+// the one node 0, and nothing is bound there.
+struct FixedAllocatorNuma {
+  static unsigned NodesCount() {
+    static const unsigned nodes_count = CountNodes();
+    return nodes_count;
+  }
+
+  // Node of the CPU which the calling thread runs on now.
+  static unsigned CurrentNode() {
+#ifdef __linux__
+    unsigned cpu = 0;
+    unsigned node = 0;
+    if (NodesCount() > 1 && syscall(SYS_getcpu, &cpu, &node, nullptr) == 0
+        && node < NodesCount()) {
+      return node;
+    }
+#endif
+    return 0;
+  }
+
+  // Asks the kernel to take the pages of the memory from node when they are
+  // first touched. memory must be page aligned. Best effort: the pages come
+  // from other nodes when node runs out.
+  static void Bind(void* const memory, const size_t bytes,
+                   const unsigned node) {
+#ifdef __linux__
+    if (NodesCount() > 1) {
+      const size_t kBitsInWord = sizeof(unsigned long) * 8;
+      unsigned long mask[kMaxNodes / kBitsInWord] = { };
+      mask[node / kBitsInWord] |= 1UL << node % kBitsInWord;
+      syscall(SYS_mbind, memory, bytes, kMpolPreferred, mask, kMaxNodes + 1,
+          0);
+    }
+#else
+    (void) memory;
+    (void) bytes;
+    (void) node;
+#endif
+  }
+
+private:
+  static const unsigned kMaxNodes = 1024;
+  // MPOL_PREFERRED of <linux/mempolicy.h>.
+  static const int kMpolPreferred = 1;
+
+  static unsigned CountNodes() {
+    unsigned nodes_count = 1;
+#ifdef __linux__
+    // A list like "0", "0-1" or "0,2-3", the last number is the highest node.
+    if (FILE* const file = std::fopen("/sys/devices/system/node/online",
+        "r")) {
+      char online[256] = { };
+      if (std::fgets(online, sizeof(online), file) != nullptr) {
+        unsigned number = 0;
+        bool in_number = false;
+        for (const char* c = online; *c != '\0'; ++c) {
+          if (*c >= '0' && *c <= '9') {
+            number = in_number ? number * 10 + (*c - '0') : *c - '0';
+            in_number = true;
+          } else if (in_number) {
+            nodes_count = number + 1;
+            in_number = false;
+          }
+        }
+        if (in_number) {
+          nodes_count = number + 1;
+        }
+      }
+      std::fclose(file);
+    }
+#endif
+    return std::min(std::max(nodes_count, 1u), unsigned(kMaxNodes));
+  }
+};
+
+// Memory of one pool.
+struct FixedAllocatorRegion {
+  // Huge page size assumed for kTransparentHugePages and kHugeTlb: the
+  // default one on x86-64 and on arm64 with 4 KiB pages.
+  static const size_t kHugePageSize = 2 * 1024 * 1024;
+
+  // Usable memory, begin is aligned as requested.
+  char* begin;
+  size_t size;
+  // The backend which actually provided the memory.
+  FixedAllocatorBackend backend;
+  // Memory as it came from the backend.
+  void* memory;
+  size_t memory_size;
+
+  // Gets at least bytes bytes starting at an address aligned to alignment, a
+  // power of 2 not bigger than kHugePageSize. Throws std::bad_alloc.
+  static FixedAllocatorRegion Reserve(const size_t bytes,
+                                      const size_t alignment,
+                                      const FixedAllocatorBackend backend) {
+    FixedAllocatorRegion region;
+#ifdef __linux__
+    if (backend == FixedAllocatorBackend::kHugeTlb
+        && region.MapHugeTlb(bytes)) {
+      return region;
+    }
+    if (backend != FixedAllocatorBackend::kHeap) {
+      region.Map(bytes, alignment,
+          backend != FixedAllocatorBackend::kMmap);
+      return region;
+    }
+#endif
+    region.backend = FixedAllocatorBackend::kHeap;
+    region.memory_size = bytes + alignment;
+    region.memory = ::operator new(region.memory_size);
+    region.begin = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(
+        region.memory) + alignment - 1) & ~(uintptr_t(alignment) - 1));
+    region.size = bytes;
+    return region;
+  }
+
+  void Release() {
+#ifdef __linux__
+    if (backend != FixedAllocatorBackend::kHeap) {
+      munmap(memory, memory_size);
+      return;
+    }
+#endif
+    ::operator delete(memory);
+  }
+
+private:
+  static size_t RoundUp(const size_t bytes, const size_t alignment) {
+    return (bytes + alignment - 1) & ~(alignment - 1);
+  }
+
+#ifdef __linux__
+  bool MapHugeTlb(const size_t bytes) {
+    const size_t huge_size = RoundUp(bytes, kHugePageSize);
+    void* const mapped = mmap(nullptr, huge_size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (mapped == MAP_FAILED) {
+      // No huge pages reserved, or all of them are taken.
+      return false;
+    }
+    backend = FixedAllocatorBackend::kHugeTlb;
+    memory = begin = static_cast<char*>(mapped);
+    memory_size = size = huge_size;
+    return true;
+  }
+
+  // Maps more than needed and unmaps the unaligned head and the tail.
+  void Map(size_t bytes, size_t alignment, const bool huge_pages) {
+    if (huge_pages) {
+      bytes = RoundUp(bytes, kHugePageSize);
+      alignment = kHugePageSize;
+    }
+    char* const mapped = static_cast<char*>(mmap(nullptr,
+        bytes + alignment, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (mapped == MAP_FAILED) {
+      throw std::bad_alloc();
+    }
+    char* const aligned = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(
+        mapped) + alignment - 1) & ~(uintptr_t(alignment) - 1));
+    if (aligned != mapped) {
+      munmap(mapped, aligned - mapped);
+    }
+    const size_t tail_size = alignment - (aligned - mapped);
+    if (tail_size != 0) {
+      munmap(aligned + bytes, tail_size);
+    }
+
+    backend = FixedAllocatorBackend::kMmap;
+    if (huge_pages && madvise(aligned, bytes, MADV_HUGEPAGE) == 0) {
+      backend = FixedAllocatorBackend::kTransparentHugePages;
+    }
+    memory = begin = aligned;
+    memory_size = size = bytes;
+  }
+#endif
+};
+
+// Snapshot of the counters of one size class.
+struct FixedAllocatorStats {
+  size_t chunk_size;
+  // Chunks handed out and not released yet. Chunks released by a thread other
+  // than the one which owns their span count as live until the owner collects
+  // them.
+  size_t live_chunks;
+  size_t pools_count;
+  // Pools built on the allocation path because the shared pool ran dry. Pools
+  // built by Reserve and by the provisioner are not counted.
+  size_t add_new_pool_calls;
+  // Memory of the pools, including the spans which were never touched.
+  size_t reserved_bytes;
+  // live_chunks * chunk_size.
+  size_t in_use_bytes;
+  // Most memory held by thread caches at once, counted in whole spans.
+  size_t high_water_bytes;
+  // Chunks handed out so far from pools on the NUMA node of the thread, and
+  // from pools on other nodes. All chunks are local on single-node machines.
+  // Chunks handed out again from chains given back by deallocate_chain are
+  // not counted.
+  size_t local_chunks;
+  size_t remote_chunks;
+  // Chunks given back by deallocate_chain and kept aside for reuse by the
+  // thread which released them. They are not live, but keep their spans in
+  // use.
+  size_t deferred_chunks;
+};
+
+// Snapshot of all TFastAllocator counters, see
+// FixedAllocatorInstancesOwner::GetStats.
+struct FastAllocatorStats {
+  // Requests bigger than FAST_ALLOCATOR_MAX_MEDIUM_SIZE or too aligned for
+  // their size class go to FastAllocatorLargeBlocks. Bucket i counts the
+  // requests of (2^(i-1), 2^i] bytes, bucket 0 the ones of 0 or 1 byte.
+  static const size_t kFallbackBuckets = sizeof(size_t) * 8 + 1;
+
+  std::vector<FixedAllocatorStats> size_classes;
+  // See FixedAllocatorNuma.
+  size_t numa_nodes;
+  size_t fallback_allocations[kFallbackBuckets];
+  size_t fallback_deallocations[kFallbackBuckets];
+  // Freed large blocks kept for reuse.
+  size_t large_cached_blocks;
+  size_t large_cached_bytes;
+  // Large requests which found a cached block, and which mapped a new one.
+  size_t large_cache_hits;
+  size_t large_cache_misses;
+};
+
+// A pool built by a FixedAllocator.
+struct FixedAllocatorPoolEvent {
+  enum Cause {
+    // AddNewPool on the allocation path: the allocating thread waited for it.
+    kOnDemand,
+    // FixedAllocatorInstancesOwner::Reserve.
+    kReserve,
+    // FixedAllocatorProvisioner thread.
+    kProvision
+  };
+
+  // steady_clock time of the start of the build.
+  uint64_t timestamp_ns;
+  uint64_t duration_ns;
+  size_t chunk_size;
+  size_t pool_bytes;
+  Cause cause;
+};
+
+// Define FAST_ALLOCATOR_TRACE to record the latency of every GiveChunk and
+// ReleaseChunk into a histogram of its size class and every pool build into
+// a ring buffer, see FixedAllocatorInstancesOwner::DumpTrace. Without it the
+// tracing types below are empty and compile to nothing.
+#ifdef FAST_ALLOCATOR_TRACE
+inline uint64_t FixedAllocatorNowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Bucket i counts the calls which took [2^(i-1), 2^i) ns, bucket 0 the ones
+// which took less than 1 ns.
+class FixedAllocatorLatencyHistogram {
+public:
+  static const size_t kBuckets = 40;
+
+  FixedAllocatorLatencyHistogram() {
+    for (auto& count : counts) {
+      count.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  void Record(uint64_t duration_ns) {
+    size_t bucket = 0;
+    for (; duration_ns != 0 && bucket != kBuckets - 1; duration_ns >>= 1) {
+      ++bucket;
+    }
+    counts[bucket].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  size_t Count(const size_t bucket) const {
+    return counts[bucket].load(std::memory_order_relaxed);
+  }
+
+  // Prints the non-empty buckets.
+  void Dump(std::ostream& out) const {
+    for (size_t bucket = 0; bucket != kBuckets; ++bucket) {
+      if (Count(bucket) != 0) {
+        out << " <" << (uint64_t(1) << bucket) << "ns:" << Count(bucket);
+      }
+    }
+  }
+
+private:
+  std::atomic<size_t> counts[kBuckets];
+};
+
+// Records the lifetime of the timer into a histogram.
+class FixedAllocatorLatencyTimer {
+public:
+  explicit FixedAllocatorLatencyTimer(
+      FixedAllocatorLatencyHistogram& histogram)
+      : histogram(histogram), start_ns(FixedAllocatorNowNs()) {
+  }
+
+  ~FixedAllocatorLatencyTimer() {
+    histogram.Record(FixedAllocatorNowNs() - start_ns);
+  }
+
+private:
+  FixedAllocatorLatencyHistogram& histogram;
+  const uint64_t start_ns;
+};
+
+// The last kCapacity pool events of all size classes. Writers claim a slot
+// with fetch_add and publish the event with a sequence number, a reader skips
+// the slots which are being rewritten, so neither side takes a lock.
+class FixedAllocatorPoolEvents {
+public:
+  static const size_t kCapacity = 1024;
+
+  static FixedAllocatorPoolEvents& Instance() {
+    static FixedAllocatorPoolEvents& instance = *new FixedAllocatorPoolEvents();
+    return instance;
+  }
+
+  void Record(const FixedAllocatorPoolEvent& event) {
+    const uint64_t index = next_index.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = slots[index % kCapacity];
+    // Release stores keep the fields from being written before the slot is
+    // marked busy, acquire loads in Snapshot keep them from being read after
+    // the sequence is checked again.
+    slot.sequence.store(0, std::memory_order_relaxed);
+    slot.timestamp_ns.store(event.timestamp_ns, std::memory_order_release);
+    slot.duration_ns.store(event.duration_ns, std::memory_order_release);
+    slot.chunk_size.store(event.chunk_size, std::memory_order_release);
+    slot.pool_bytes.store(event.pool_bytes, std::memory_order_release);
+    slot.cause.store(event.cause, std::memory_order_release);
+    slot.sequence.store(index + 1, std::memory_order_release);
+  }
+
+  // Events from the oldest to the newest.
+  std::vector<FixedAllocatorPoolEvent> Snapshot() const {
+    std::vector<FixedAllocatorPoolEvent> events;
+    const uint64_t end = next_index.load(std::memory_order_acquire);
+    const uint64_t begin = end > kCapacity ? end - kCapacity : 0;
+    for (uint64_t index = begin; index != end; ++index) {
+      const Slot& slot = slots[index % kCapacity];
+      if (slot.sequence.load(std::memory_order_acquire) != index + 1) {
+        continue;
+      }
+      FixedAllocatorPoolEvent event;
+      event.timestamp_ns = slot.timestamp_ns.load(std::memory_order_acquire);
+      event.duration_ns = slot.duration_ns.load(std::memory_order_acquire);
+      event.chunk_size = slot.chunk_size.load(std::memory_order_acquire);
+      event.pool_bytes = slot.pool_bytes.load(std::memory_order_acquire);
+      event.cause = slot.cause.load(std::memory_order_acquire);
+      if (slot.sequence.load(std::memory_order_relaxed) == index + 1) {
+        events.push_back(event);
+      }
+    }
+    return events;
+  }
+
+private:
+  struct Slot {
+    // Index of the event in the slot plus 1, 0 while it is being written.
+    std::atomic<uint64_t> sequence;
+    std::atomic<uint64_t> timestamp_ns;
+    std::atomic<uint64_t> duration_ns;
+    std::atomic<size_t> chunk_size;
+    std::atomic<size_t> pool_bytes;
+    std::atomic<FixedAllocatorPoolEvent::Cause> cause;
+  };
+
+  FixedAllocatorPoolEvents()
+      : next_index(0), slots() {
+  }
+
+  std::atomic<uint64_t> next_index;
+  Slot slots[kCapacity];
+};
+#else
+struct FixedAllocatorLatencyHistogram {
+};
+
+struct FixedAllocatorLatencyTimer {
+  explicit FixedAllocatorLatencyTimer(FixedAllocatorLatencyHistogram&) {
+  }
+};
+#endif
+
+template<typename T, size_t MinAlignment = 0>
+class TFastAllocator;
+
+class FixedAllocatorBase {
+  template<typename T, size_t MinAlignment>
+  friend class TFastAllocator;
+  friend class FixedAllocatorInstancesOwner;
+  friend class FixedAllocatorProvisioner;
+  friend class TFastMemoryResource;
+
+public:
+  // Chunks of every size class start at a cache line boundary of their span.
+  static const size_t kCacheLineSize = 64;
+
+protected:
+  virtual ~FixedAllocatorBase() {
+  }
+  virtual void* GiveChunk() = 0;
+  virtual void ReleaseChunk(void* chunk_to_release) = 0;
+
+  virtual void SetGrowthPolicy(const FixedAllocatorGrowthPolicy& policy) = 0;
+  // Makes the shared pool hold at least chunks free chunks.
+  virtual void Reserve(size_t chunks) = 0;
+  // Asks FixedAllocatorProvisioner to refill the shared pool whenever it holds
+  // less than chunks free chunks.
+  virtual void SetLowWatermark(size_t chunks) = 0;
+  // Refills the shared pool up to the low watermark.
+  virtual void Provision() = 0;
+  // Gives pools without chunks in use back to the system. Returns the number
+  // of bytes released.
+  virtual size_t Trim() = 0;
+  virtual void SetAutoTrim(bool enabled, size_t retained_chunks) = 0;
+  // Takes memory of the next pools from backend.
+  virtual void SetBackend(FixedAllocatorBackend backend) = 0;
+  virtual FixedAllocatorStats GetStats() = 0;
+#ifdef FAST_ALLOCATOR_TRACE
+  // Prints the latency histograms of the size class.
+  virtual void DumpLatencies(std::ostream& out) = 0;
+#endif
+};
+
+#ifdef FAST_ALLOCATOR_THREAD_SAFE
+// Helper thread which builds new pools ahead of demand, so that allocations
+// do not stall on AddNewPool. It serves the FixedAllocators with a low
+// watermark set, see FixedAllocatorInstancesOwner::SetLowWatermark.
+class FixedAllocatorProvisioner {
+  template<size_t ChunkSize>
+  friend class FixedAllocator;
+
+public:
+  static void Start() {
+    Instance().StartThread();
+  }
+
+  static void Stop() {
+    Instance().StopThread();
+  }
+
+private:
+  FixedAllocatorProvisioner()
+      : running(false) {
+  }
+
+  ~FixedAllocatorProvisioner() {
+    StopThread();
+  }
+
+  static FixedAllocatorProvisioner& Instance() {
+    static FixedAllocatorProvisioner provisioner;
+    return provisioner;
+  }
+
+  // Returns false if the thread is not running.
+  static bool Request(FixedAllocatorBase* const allocator) {
+    FixedAllocatorProvisioner& provisioner = Instance();
+    std::lock_guard<std::mutex> lock(provisioner.mutex);
+    if (!provisioner.running) {
+      return false;
+    }
+    provisioner.requests.push_back(allocator);
+    provisioner.wakeup.notify_one();
+    return true;
+  }
+
+  void StartThread() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!running) {
+      running = true;
+      thread = std::thread(&FixedAllocatorProvisioner::Run, this);
+    }
+  }
+
+  void StopThread() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!running) {
+        return;
+      }
+      running = false;
+      wakeup.notify_one();
+    }
+    thread.join();
+  }
+
+  void Run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running) {
+      if (requests.empty()) {
+        wakeup.wait(lock);
+        continue;
+      }
+      FixedAllocatorBase* const allocator = requests.back();
+      requests.pop_back();
+      lock.unlock();
+      allocator->Provision();
+      lock.lock();
+    }
+  }
+
+  std::mutex mutex;
+  std::condition_variable wakeup;
+  std::vector<FixedAllocatorBase*> requests;
+  std::thread thread;
+  bool running;
+};
+#endif
+
+template<size_t ChunkSize>
+class FixedAllocator final : FixedAllocatorBase {
+  friend class FixedAllocatorInstancesOwner;
+  template<typename T, size_t MinAlignment>
+  friend class TFastAllocator;
+
+private:
+  // Free chunk. Chunks are laid out ChunkSize bytes apart, the link takes the
+  // first bytes of the chunk.
+  struct Chunk {
+    Chunk* next;
+
+    Chunk()
+        : next(nullptr) {
+    }
+
+    Chunk(Chunk* const next)
+        : next(next) {
+    }
+  };
+
+  struct ThreadCache;
+  struct Pool;
+
+  // Pools are cut into spans of kSpanSize bytes aligned to kSpanSize, so the
+  // span of a chunk is found by masking the chunk address. A span belongs to
+  // one thread cache, and only the thread of that cache touches its free list.
+  // Chunks are carved from the span by bumping unused_begin, the free list
+  // holds only the chunks which were released since.
+  struct Span {
+    ThreadCache* owner;
+    Pool* pool;
+    Chunk* free_head;
+    char* unused_begin;
+    // Chunks of the span which are handed out and not yet returned to it.
+    size_t used;
+    // Links in the list of the owner's spans with free chunks, or in the list
+    // of free spans of the pool while the span is in the shared pool.
+    Span* prev;
+    Span* next;
+  };
+
+  // Spans of one thread. Other threads give chunks of these spans back
+  // through remote_head, the owner takes them in its next GiveChunk which
+  // misses the fast path. Caches are never destroyed while the allocator is
+  // alive: when a thread exits, its cache keeps its spans and waits for a new
+  // thread to adopt it.
+  struct ThreadCache {
+    Span* current;
+    // Whether current comes from a pool on another NUMA node.
+    bool current_remote;
+    // NUMA node of the thread when it attached the cache. Threads which move
+    // to another node later keep taking spans of this one.
+    unsigned numa_node;
+    // Spans with free chunks other than current.
+    Span* partial_head;
+    std::atomic<Chunk*> remote_head;
+    ThreadCache* next_abandoned;
+    // Chains released by ReleaseChain whose first chunk is of a span of this
+    // cache. They are handed out again before the current span is touched,
+    // and go back to their spans when more than kMaxDeferredChunks pile up,
+    // on Trim and on thread exit.
+    Chunk* deferred_head;
+    // Chunks handed out from and returned to the spans of the cache, and
+    // chunks in deferred_head. Only the thread of the cache writes them,
+    // GetStats reads them.
+    std::atomic<size_t> given_chunks;
+    std::atomic<size_t> released_chunks;
+    std::atomic<size_t> deferred_chunks;
+    // Part of given_chunks handed out from spans of other NUMA nodes.
+    std::atomic<size_t> remote_given_chunks;
+
+    ThreadCache()
+        : current(nullptr), current_remote(false), numa_node(0),
+          partial_head(nullptr), remote_head(nullptr), next_abandoned(nullptr),
+          deferred_head(nullptr), given_chunks(0), released_chunks(0),
+          deferred_chunks(0), remote_given_chunks(0) {
+    }
+
+    // Counts chunks handed out from span.
+    void CountGiven(const Span* const span, const size_t count = 1) {
+      Count(given_chunks, count);
+      if (span->pool->numa_node != numa_node) {
+        Count(remote_given_chunks, count);
+      }
+    }
+
+    // Cheaper than fetch_add, there is a single writer.
+    static void Count(std::atomic<size_t>& counter, const size_t count = 1) {
+      counter.store(counter.load(std::memory_order_relaxed) + count,
+          std::memory_order_relaxed);
+    }
+  };
+
+  // Hands the cache of a thread to the next thread to come on thread exit.
+  class ThreadCacheReaper {
+  public:
+    ThreadCacheReaper(FixedAllocator* const owner)
+        : owner(owner) {
+    }
+
+    ~ThreadCacheReaper() {
+      if (thread_cache != nullptr) {
+        owner->AbandonThreadCache(thread_cache);
+        thread_cache = nullptr;
+      }
+    }
+
+  private:
+    FixedAllocator* const owner;
+  };
+
+  struct Pool {
+    FixedAllocatorRegion region;
+    // NUMA node the memory is bound to.
+    unsigned numa_node;
+    char* spans_begin;
+    size_t spans_count;
+    // Spans in [unused_spans_begin, spans end) were never taken.
+    char* unused_spans_begin;
+    // Spans which were taken and given back.
+    Span* free_spans_head;
+    // Spans owned by thread caches. Every chunk of the pool is free when
+    // this is 0, and the pool can be given back to the system.
+    size_t spans_in_use;
+
+    bool HasSpareSpans() const {
+      return free_spans_head != nullptr
+          || unused_spans_begin != spans_begin + spans_count * kSpanSize;
+    }
+  };
+
+  static const size_t kSpanSize = 64 * 1024;
+  static const size_t kChunksOffset = (sizeof(Span) + kCacheLineSize - 1)
+      / kCacheLineSize * kCacheLineSize;
+  static const size_t kChunksInSpan = (kSpanSize - kChunksOffset)
+      / ChunkSize;
+  static const size_t kChunksEnd = kChunksOffset + kChunksInSpan * ChunkSize;
+  // ReleaseChain gives the deferred chunks of a cache back to their spans
+  // past this many, so that chains which are not allocated again soon do not
+  // pin more than a few spans.
+  static const size_t kMaxDeferredChunks = 8 * kChunksInSpan;
+
+  static_assert(ChunkSize >= sizeof(Chunk) && ChunkSize % alignof(Chunk) == 0,
+      "ChunkSize must be a multiple of the pointer size");
+  static_assert(kChunksInSpan >= 8, "ChunkSize is too big for a span");
+
+  FixedAllocator(const FixedAllocatorGrowthPolicy& growth_policy)
+      : spare_spans(0), low_watermark_spans(0), provisioning_requested(false),
+        auto_trim(false), auto_trim_retained_spans(0), spans_in_use(0),
+        high_water_spans(0), add_new_pool_calls(0), provisioning_numa_node(0),
+        abandoned_caches(nullptr), growth_policy(growth_policy),
+        backend(FixedAllocatorBackend::kHeap) {
+  }
+
+  FixedAllocator(const FixedAllocator& other) = delete;
+
+  ~FixedAllocator() {
+    for (auto cache : thread_caches) {
+      delete cache;
+    }
+    for (auto pool : chunks_pools) {
+      pool->region.Release();
+      delete pool;
+    }
+  }
+
+  FixedAllocator& operator=(const FixedAllocator& other) = delete;
+
+  static Span* SpanOf(void* const chunk) {
+    return reinterpret_cast<Span*>(reinterpret_cast<uintptr_t>(chunk)
+        & ~(uintptr_t(kSpanSize) - 1));
+  }
+
+  // Reserves memory for a pool of at least the given number of chunks on the
+  // NUMA node. The memory is not touched here: spans are set up one by one
+  // when threads take them, and chunks of a span when they are handed out.
+  // A region rounded up to huge pages gets more spans than asked for.
+  static Pool* ReservePool(const size_t chunks,
+                           const FixedAllocatorBackend backend,
+                           const FixedAllocatorPoolEvent::Cause cause,
+                           const unsigned numa_node) {
+#ifdef FAST_ALLOCATOR_TRACE
+    const uint64_t start_ns = FixedAllocatorNowNs();
+#endif
+    std::unique_ptr<Pool> pool(new Pool());
+    const size_t spans_count = std::max<size_t>(
+        (chunks + kChunksInSpan - 1) / kChunksInSpan, 1);
+    pool->region = FixedAllocatorRegion::Reserve(spans_count * kSpanSize,
+        kSpanSize, backend);
+    pool->spans_begin = pool->region.begin;
+    pool->spans_count = pool->region.size / kSpanSize;
+    pool->unused_spans_begin = pool->spans_begin;
+    pool->numa_node = numa_node;
+    FixedAllocatorNuma::Bind(pool->region.begin, pool->region.size, numa_node);
+#ifdef FAST_ALLOCATOR_TRACE
+    FixedAllocatorPoolEvents::Instance().Record(FixedAllocatorPoolEvent {
+        start_ns, FixedAllocatorNowNs() - start_ns, ChunkSize,
+        pool->region.memory_size, cause });
+#else
+    (void) cause;
+#endif
+    return pool.release();
+  }
+
+  // Must be called under pool_mutex.
+  void AddPool(Pool* const pool) {
+    chunks_pools.push_back(pool);
+    spare_spans += pool->spans_count;
+  }
+
+  // Must be called under pool_mutex.
+  void AddNewPool(const unsigned numa_node) {
+    ++add_new_pool_calls;
+    AddPool(ReservePool(growth_policy.ChunksInPool(chunks_pools.size()),
+        backend, FixedAllocatorPoolEvent::kOnDemand, numa_node));
+  }
+
+  // Spare spans of the pools on the NUMA node. Must be called under
+  // pool_mutex.
+  size_t SpareSpans(const unsigned numa_node) const {
+    if (FixedAllocatorNuma::NodesCount() == 1) {
+      return spare_spans;
+    }
+    size_t node_spare_spans = 0;
+    for (auto pool : chunks_pools) {
+      if (pool->numa_node == numa_node) {
+        node_spare_spans += pool->spans_count - pool->spans_in_use;
+      }
+    }
+    return node_spare_spans;
+  }
+
+  // Must be called under pool_mutex.
+  void RequestProvisioning() {
+#ifdef FAST_ALLOCATOR_THREAD_SAFE
+    if (!provisioning_requested && spare_spans < low_watermark_spans) {
+      provisioning_requested = FixedAllocatorProvisioner::Request(this);
+    }
+#endif
+  }
+
+  // Takes a span from the fullest pool on the NUMA node of the cache which
+  // has one, so that the other pools get a chance to become free and to be
+  // trimmed. Pools of other nodes are left to the threads there.
+  Span* TakeSpan(ThreadCache* const cache) {
+    std::lock_guard<FixedAllocatorMutex> lock(pool_mutex);
+    Pool* pool = nullptr;
+    for (auto candidate : chunks_pools) {
+      if (candidate->numa_node == cache->numa_node
+          && candidate->HasSpareSpans() && (pool == nullptr
+          || candidate->spans_in_use > pool->spans_in_use)) {
+        pool = candidate;
+      }
+    }
+    if (pool == nullptr) {
+      // Out of free chunks and nobody provisioned the pool in time.
+      AddNewPool(cache->numa_node);
+      pool = chunks_pools.back();
+    }
+
+    Span* span = pool->free_spans_head;
+    if (span != nullptr) {
+      pool->free_spans_head = span->next;
+    } else {
+      span = new (pool->unused_spans_begin) Span();
+      span->pool = pool;
+      span->unused_begin = pool->unused_spans_begin + kChunksOffset;
+      pool->unused_spans_begin += kSpanSize;
+    }
+    span->owner = cache;
+    ++pool->spans_in_use;
+    --spare_spans;
+    ++spans_in_use;
+    high_water_spans = std::max(high_water_spans, spans_in_use);
+    provisioning_numa_node = cache->numa_node;
+    RequestProvisioning();
+    return span;
+  }
+
+  void PutSpan(Span* const span) {
+    std::lock_guard<FixedAllocatorMutex> lock(pool_mutex);
+    Pool* const pool = span->pool;
+    span->owner = nullptr;
+    span->next = pool->free_spans_head;
+    pool->free_spans_head = span;
+    ++spare_spans;
+    --spans_in_use;
+    if (--pool->spans_in_use == 0 && auto_trim) {
+      // Release free pools only when more than twice as many spans as should
+      // be kept are spare besides this pool, so that a workload oscillating
+      // around a pool boundary does not build and release a pool every turn.
+      const size_t kept_spans = std::max(low_watermark_spans,
+          auto_trim_retained_spans);
+      if (spare_spans > 2 * kept_spans + pool->spans_count) {
+        ReleaseFreePoolsLocked(kept_spans);
+      }
+    }
+  }
+
+  // Gives pools without chunks in use back to the system while at least
+  // kept_spans spare spans remain. Returns the number of bytes released. Must
+  // be called under pool_mutex.
+  size_t ReleaseFreePoolsLocked(const size_t kept_spans) {
+    size_t released_bytes = 0;
+    for (size_t pool_index = chunks_pools.size(); pool_index-- != 0;) {
+      Pool* const pool = chunks_pools[pool_index];
+      if (pool->spans_in_use != 0
+          || spare_spans < kept_spans + pool->spans_count) {
+        continue;
+      }
+      spare_spans -= pool->spans_count;
+      released_bytes += pool->region.memory_size;
+      chunks_pools.erase(chunks_pools.begin() + pool_index);
+      pool->region.Release();
+      delete pool;
+    }
+    return released_bytes;
+  }
+
+  // Gives the current span of a cache back to the shared pool if it has no
+  // chunks in use. The cache must belong to the calling thread or be
+  // detached from abandoned_caches.
+  void TrimThreadCache(ThreadCache* const cache) {
+    ReleaseDeferredChunks(cache);
+    CollectRemoteChunks(cache);
+    Span* const span = cache->current;
+    if (span != nullptr && span->used == 0) {
+      cache->current = nullptr;
+      cache->current_remote = false;
+      PutSpan(span);
+    }
+  }
+
+  virtual size_t Trim() {
+    if (thread_cache != nullptr) {
+      TrimThreadCache(thread_cache);
+    }
+
+    ThreadCache* abandoned;
+    {
+      std::lock_guard<FixedAllocatorMutex> lock(pool_mutex);
+      abandoned = abandoned_caches;
+      abandoned_caches = nullptr;
+    }
+    ThreadCache* abandoned_tail = nullptr;
+    for (ThreadCache* cache = abandoned; cache != nullptr;
+        cache = cache->next_abandoned) {
+      TrimThreadCache(cache);
+      abandoned_tail = cache;
+    }
+
+    std::lock_guard<FixedAllocatorMutex> lock(pool_mutex);
+    if (abandoned_tail != nullptr) {
+      abandoned_tail->next_abandoned = abandoned_caches;
+      abandoned_caches = abandoned;
+    }
+    return ReleaseFreePoolsLocked(low_watermark_spans);
+  }
+
+  virtual void SetAutoTrim(const bool enabled, const size_t retained_chunks) {
+    std::lock_guard<FixedAllocatorMutex> lock(pool_mutex);
+    auto_trim = enabled;
+    auto_trim_retained_spans = (retained_chunks + kChunksInSpan - 1)
+        / kChunksInSpan;
+  }
+
+  virtual void SetGrowthPolicy(const FixedAllocatorGrowthPolicy& policy) {
+    std::lock_guard<FixedAllocatorMutex> lock(pool_mutex);
+    growth_policy = policy;
+  }
+
+  // Reserves on the NUMA node of the calling thread.
+  virtual void Reserve(const size_t chunks) {
+    ReserveChunks(chunks, FixedAllocatorPoolEvent::kReserve,
+        FixedAllocatorNuma::CurrentNode());
+  }
+
+  void ReserveChunks(const size_t chunks,
+                     const FixedAllocatorPoolEvent::Cause cause,
+                     const unsigned numa_node) {
+    const size_t spans = (chunks + kChunksInSpan - 1) / kChunksInSpan;
+    std::unique_lock<FixedAllocatorMutex> lock(pool_mutex);
+    for (size_t node_spare_spans = SpareSpans(numa_node);
+        node_spare_spans < spans; node_spare_spans = SpareSpans(numa_node)) {
+      const size_t pool_chunks = std::max(
+          growth_policy.ChunksInPool(chunks_pools.size()),
+          (spans - node_spare_spans) * kChunksInSpan);
+      const FixedAllocatorBackend pool_backend = backend;
+      lock.unlock();
+      Pool* const pool = ReservePool(pool_chunks, pool_backend, cause,
+          numa_node);
+      lock.lock();
+      AddPool(pool);
+    }
+  }
+
+  virtual void SetBackend(const FixedAllocatorBackend backend) {
+    std::lock_guard<FixedAllocatorMutex> lock(pool_mutex);
+    this->backend = backend;
+  }
+
+  virtual FixedAllocatorStats GetStats() {
+    FixedAllocatorStats stats = FixedAllocatorStats();
+    stats.chunk_size = ChunkSize;
+    std::lock_guard<FixedAllocatorMutex> lock(pool_mutex);
+    for (auto cache : thread_caches) {
+      const size_t given = cache->given_chunks.load(std::memory_order_relaxed);
+      const size_t remote = cache->remote_given_chunks.load(
+          std::memory_order_relaxed);
+      stats.local_chunks += given - remote;
+      stats.remote_chunks += remote;
+      stats.live_chunks += given;
+      stats.live_chunks -= cache->released_chunks.load(
+          std::memory_order_relaxed);
+      const size_t deferred = cache->deferred_chunks.load(
+          std::memory_order_relaxed);
+      stats.live_chunks -= deferred;
+      stats.deferred_chunks += deferred;
+    }
+    stats.pools_count = chunks_pools.size();
+    stats.add_new_pool_calls = add_new_pool_calls;
+    for (auto pool : chunks_pools) {
+      stats.reserved_bytes += pool->region.memory_size;
+    }
+    stats.in_use_bytes = stats.live_chunks * ChunkSize;
+    stats.high_water_bytes = high_water_spans * kSpanSize;
+    return stats;
+  }
+
+#ifdef FAST_ALLOCATOR_TRACE
+  virtual void DumpLatencies(std::ostream& out) {
+    out << "chunk_size=" << ChunkSize << " GiveChunk:";
+    give_latency.Dump(out);
+    out << "\nchunk_size=" << ChunkSize << " ReleaseChunk:";
+    release_latency.Dump(out);
+    out << "\n";
+  }
+#endif
+
+  virtual void SetLowWatermark(const size_t chunks) {
+    std::lock_guard<FixedAllocatorMutex> lock(pool_mutex);
+    low_watermark_spans = (chunks + kChunksInSpan - 1) / kChunksInSpan;
+    provisioning_numa_node = FixedAllocatorNuma::CurrentNode();
+    RequestProvisioning();
+  }
+
+  // Provisions the NUMA node of the thread which took a span last.
+  virtual void Provision() {
+    size_t low_watermark_chunks;
+    unsigned numa_node;
+    {
+      std::lock_guard<FixedAllocatorMutex> lock(pool_mutex);
+      provisioning_requested = false;
+      low_watermark_chunks = low_watermark_spans * kChunksInSpan;
+      numa_node = provisioning_numa_node;
+    }
+    ReserveChunks(low_watermark_chunks, FixedAllocatorPoolEvent::kProvision,
+        numa_node);
+  }
+
+  ThreadCache* AttachThreadCache() {
+    static FAST_ALLOCATOR_THREAD_LOCAL ThreadCacheReaper reaper(this);
+    const unsigned numa_node = FixedAllocatorNuma::CurrentNode();
+    std::lock_guard<FixedAllocatorMutex> lock(pool_mutex);
+    if (abandoned_caches != nullptr) {
+      thread_cache = abandoned_caches;
+      abandoned_caches = abandoned_caches->next_abandoned;
+    } else {
+      thread_caches.push_back(new ThreadCache());
+      thread_cache = thread_caches.back();
+    }
+    // An adopted cache keeps its spans, which may be on another node.
+    thread_cache->numa_node = numa_node;
+    thread_cache->current_remote = thread_cache->current != nullptr
+        && thread_cache->current->pool->numa_node != numa_node;
+    return thread_cache;
+  }
+
+  void AbandonThreadCache(ThreadCache* const cache) {
+    ReleaseDeferredChunks(cache);
+    std::lock_guard<FixedAllocatorMutex> lock(pool_mutex);
+    cache->next_abandoned = abandoned_caches;
+    abandoned_caches = cache;
+  }
+
+  static void LinkPartial(ThreadCache* const cache, Span* const span) {
+    span->prev = nullptr;
+    span->next = cache->partial_head;
+    if (cache->partial_head != nullptr) {
+      cache->partial_head->prev = span;
+    }
+    cache->partial_head = span;
+  }
+
+  static void UnlinkPartial(ThreadCache* const cache, Span* const span) {
+    if (span->prev != nullptr) {
+      span->prev->next = span->next;
+    } else {
+      cache->partial_head = span->next;
+    }
+    if (span->next != nullptr) {
+      span->next->prev = span->prev;
+    }
+  }
+
+  // Returns nullptr if the span is out of chunks.
+  static void* TakeChunk(Span* const span) {
+    Chunk* const chunk = span->free_head;
+    if (chunk != nullptr) {
+      span->free_head = chunk->next;
+      ++span->used;
+      chunk->~Chunk();
+      return static_cast<void*>(chunk);
+    }
+
+    char* const unused_end = reinterpret_cast<char*>(span) + kChunksEnd;
+    if (span->unused_begin != unused_end) {
+      void* const new_memory_ptr = span->unused_begin;
+      span->unused_begin += ChunkSize;
+      ++span->used;
+      return new_memory_ptr;
+    }
+
+    return nullptr;
+  }
+
+  // Returns a chunk to a span of the cache of the calling thread. Spans other
+  // than the current one are always carved completely, so such a span without
+  // free chunks is full.
+  void ReleaseOwnChunk(ThreadCache* const cache,
+                       Span* const span,
+                       void* const chunk_to_release) {
+    Chunk* const chunk = new (chunk_to_release) Chunk();
+    ReleaseOwnRun(cache, span, chunk, chunk, 1);
+  }
+
+  // Returns length chunks of a span of the cache of the calling thread at
+  // once, linked through next from first to last.
+  void ReleaseOwnRun(ThreadCache* const cache,
+                     Span* const span,
+                     Chunk* const first,
+                     Chunk* const last,
+                     const size_t length) {
+    const bool was_full = span->free_head == nullptr;
+    last->next = span->free_head;
+    span->free_head = first;
+    span->used -= length;
+    ThreadCache::Count(cache->released_chunks, length);
+    if (span == cache->current) {
+      return;
+    }
+    if (span->used == 0) {
+      // Give the span back to the shared pool, every chunk of it is free.
+      if (!was_full) {
+        UnlinkPartial(cache, span);
+      }
+      PutSpan(span);
+    } else if (was_full) {
+      LinkPartial(cache, span);
+    }
+  }
+
+  // Takes back the chunks which other threads released to the cache. Chains
+  // released by ReleaseChain are queued whole to the owner of their first
+  // chunk, so chunks of other caches are passed on to their owners.
+  void CollectRemoteChunks(ThreadCache* const cache) {
+    if (cache->remote_head.load(std::memory_order_relaxed) == nullptr) {
+      return;
+    }
+    ReleaseRuns(cache, cache->remote_head.exchange(nullptr,
+        std::memory_order_acquire));
+  }
+
+  // Releases the chunks linked through next from chunk on, ended by nullptr,
+  // on behalf of the thread of the cache. Neighbouring chunks of one span
+  // are released as one run: the span and its owner are looked up once per
+  // run, and runs of other caches are queued to their owners with one
+  // exchange.
+  void ReleaseRuns(ThreadCache* const cache, Chunk* chunk) {
+    while (chunk != nullptr) {
+      Span* const span = SpanOf(chunk);
+      Chunk* last = chunk;
+      size_t length = 1;
+      while (last->next != nullptr && SpanOf(last->next) == span) {
+        last = last->next;
+        ++length;
+      }
+      Chunk* const next = last->next;
+      if (span->owner == cache) {
+        ReleaseOwnRun(cache, span, chunk, last, length);
+      } else {
+        QueueRemote(span->owner, chunk, last);
+      }
+      chunk = next;
+    }
+  }
+
+  // Pushes the chunks linked through next from first to last onto the
+  // remote_head of owner.
+  static void QueueRemote(ThreadCache* const owner,
+                          Chunk* const first,
+                          Chunk* const last) {
+    Chunk* head = owner->remote_head.load(std::memory_order_relaxed);
+    do {
+      last->next = head;
+    } while (!owner->remote_head.compare_exchange_weak(head, first,
+        std::memory_order_release, std::memory_order_relaxed));
+  }
+
+  // Slow path of GiveChunk: the calling thread has no cache yet, or the
+  // current span of its cache is out of free chunks.
+  void* GiveChunkFromNewSpan() {
+    ThreadCache* cache = thread_cache;
+    if (cache == nullptr) {
+      cache = AttachThreadCache();
+    }
+    CollectRemoteChunks(cache);
+
+    void* chunk = nullptr;
+    if (cache->current != nullptr) {
+      chunk = TakeChunk(cache->current);
+    }
+    if (chunk == nullptr) {
+      chunk = TakeChunk(NextSpan(cache));
+    }
+    cache->CountGiven(cache->current);
+    return chunk;
+  }
+
+  // Replaces the current span of the cache, which is out of free chunks, with
+  // a span which has some.
+  Span* NextSpan(ThreadCache* const cache) {
+    Span* span;
+    if (cache->partial_head != nullptr) {
+      span = cache->partial_head;
+      UnlinkPartial(cache, span);
+    } else {
+      span = TakeSpan(cache);
+    }
+    cache->current = span;
+    cache->current_remote = span->pool->numa_node != cache->numa_node;
+    return span;
+  }
+
+  // Hands out count chunks at once, chunks[i] gets one of them. Cheaper than
+  // count calls of GiveChunk: the thread cache is looked up once, and spans
+  // are switched without leaving the loop. On failure no chunk is handed out.
+  template<typename Pointer>
+  void GiveChunks(Pointer* const chunks, const size_t count) {
+    ThreadCache* cache = thread_cache;
+    if (cache == nullptr) {
+      cache = AttachThreadCache();
+    }
+    CollectRemoteChunks(cache);
+
+    // Deferred chunks go first, they are not counted as given again.
+    size_t given = 0;
+    Chunk* deferred = cache->deferred_head;
+    for (; given != count && deferred != nullptr; ++given) {
+      chunks[given] = static_cast<Pointer>(static_cast<void*>(deferred));
+      deferred = deferred->next;
+    }
+    cache->deferred_head = deferred;
+    const size_t reused = given;
+    cache->deferred_chunks.store(cache->deferred_chunks.load(
+        std::memory_order_relaxed) - reused, std::memory_order_relaxed);
+    try {
+      Span* span = cache->current;
+      while (given != count) {
+        if (span == nullptr) {
+          span = NextSpan(cache);
+        }
+        const size_t given_before = given;
+        Chunk* chunk = span->free_head;
+        for (; given != count && chunk != nullptr; ++given) {
+          chunks[given] = static_cast<Pointer>(static_cast<void*>(chunk));
+          chunk = chunk->next;
+        }
+        span->free_head = chunk;
+        char* unused_begin = span->unused_begin;
+        char* const unused_end = reinterpret_cast<char*>(span) + kChunksEnd;
+        for (; given != count && unused_begin != unused_end; ++given) {
+          chunks[given] = static_cast<Pointer>(static_cast<void*>(
+              unused_begin));
+          unused_begin += ChunkSize;
+        }
+        span->unused_begin = unused_begin;
+        span->used += given - given_before;
+        if (span->pool->numa_node != cache->numa_node) {
+          ThreadCache::Count(cache->remote_given_chunks, given - given_before);
+        }
+        if (given != count) {
+          // The span is out of chunks.
+          span = nullptr;
+        }
+      }
+    } catch (...) {
+      ThreadCache::Count(cache->given_chunks, given - reused);
+      ReleaseChunks(chunks, given);
+      throw;
+    }
+    ThreadCache::Count(cache->given_chunks, count - reused);
+  }
+
+  template<typename Pointer>
+  void ReleaseChunks(Pointer* const chunks, const size_t count) {
+    for (size_t i = 0; i != count; ++i) {
+      ReleaseChunk(static_cast<void*>(chunks[i]));
+    }
+  }
+
+  virtual void* GiveChunk() {
+    FixedAllocatorLatencyTimer timer(give_latency);
+    ThreadCache* const cache = thread_cache;
+    if (cache != nullptr) {
+      if (cache->deferred_head != nullptr) {
+        return TakeDeferredChunk(cache);
+      }
+      if (cache->current != nullptr) {
+        void* const chunk = TakeChunk(cache->current);
+        if (chunk != nullptr) {
+          ThreadCache::Count(cache->given_chunks);
+          if (cache->current_remote) {
+            ThreadCache::Count(cache->remote_given_chunks);
+          }
+          return chunk;
+        }
+      }
+    }
+
+    return GiveChunkFromNewSpan();
+  }
+
+  // The chunk stays counted in the used chunks of its span all the time it
+  // is deferred, so it is handed out as is.
+  static void* TakeDeferredChunk(ThreadCache* const cache) {
+    Chunk* const chunk = cache->deferred_head;
+    cache->deferred_head = chunk->next;
+    cache->deferred_chunks.store(cache->deferred_chunks.load(
+        std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+    chunk->~Chunk();
+    return static_cast<void*>(chunk);
+  }
+
+  // Takes back count chunks at once, in O(1). first is the first of them,
+  // last is the last one, and the first bytes of every chunk but last point
+  // to the next one, like the links of Chunk. The chain goes as a whole by
+  // the owner of the span of first: a chain of the calling thread is put
+  // aside and handed out again before its spans are touched, a chain of
+  // another thread is queued to it. Chunks of other spans in the chain find
+  // their owners when the chain is given back to the spans. Past
+  // kMaxDeferredChunks the chunks put aside go back to their spans.
+  void ReleaseChain(void* const first, void* const last, const size_t count) {
+    ThreadCache* cache = thread_cache;
+    if (cache == nullptr) {
+      cache = AttachThreadCache();
+    }
+    Chunk* const first_chunk = static_cast<Chunk*>(first);
+    Chunk* const last_chunk = static_cast<Chunk*>(last);
+    ThreadCache* const owner = SpanOf(first_chunk)->owner;
+    if (owner != cache) {
+      QueueRemote(owner, first_chunk, last_chunk);
+      return;
+    }
+    last_chunk->next = cache->deferred_head;
+    cache->deferred_head = first_chunk;
+    ThreadCache::Count(cache->deferred_chunks, count);
+    if (cache->deferred_chunks.load(std::memory_order_relaxed)
+        > kMaxDeferredChunks) {
+      ReleaseDeferredChunks(cache);
+    }
+  }
+
+  // Gives the chunks of the deferred chains back to their spans, a run of
+  // one span at a time. The cache must belong to the calling thread or be
+  // detached from abandoned_caches.
+  void ReleaseDeferredChunks(ThreadCache* const cache) {
+    Chunk* const chunk = cache->deferred_head;
+    cache->deferred_head = nullptr;
+    cache->deferred_chunks.store(0, std::memory_order_relaxed);
+    ReleaseRuns(cache, chunk);
+  }
+
+  virtual void ReleaseChunk(void* chunk_to_release) {
+    FixedAllocatorLatencyTimer timer(release_latency);
+    ReleaseChunkOf(thread_cache, chunk_to_release);
+  }
+
+  // Releases a chunk on behalf of the thread of the cache, which may be
+  // nullptr.
+  void ReleaseChunkOf(ThreadCache* const cache, void* const chunk_to_release) {
+    Span* const span = SpanOf(chunk_to_release);
+    ThreadCache* const owner = span->owner;
+    if (owner == cache) {
+      ReleaseOwnChunk(owner, span, chunk_to_release);
+      return;
+    }
+
+    // The chunk came from a span of another thread: queue it to the owner.
+    Chunk* const chunk = new (chunk_to_release) Chunk();
+    QueueRemote(owner, chunk, chunk);
+  }
+
+  static FAST_ALLOCATOR_THREAD_LOCAL ThreadCache* thread_cache;
+
+  FixedAllocatorMutex pool_mutex;
+  std::vector<Pool*> chunks_pools;
+  // Spans of all pools which are not owned by thread caches.
+  size_t spare_spans;
+  size_t low_watermark_spans;
+  bool provisioning_requested;
+  bool auto_trim;
+  size_t auto_trim_retained_spans;
+  // Spans owned by thread caches.
+  size_t spans_in_use;
+  size_t high_water_spans;
+  size_t add_new_pool_calls;
+  unsigned provisioning_numa_node;
+  std::vector<ThreadCache*> thread_caches;
+  ThreadCache* abandoned_caches;
+  FixedAllocatorGrowthPolicy growth_policy;
+  FixedAllocatorBackend backend;
+  FixedAllocatorLatencyHistogram give_latency;
+  FixedAllocatorLatencyHistogram release_latency;
+};
+
+template<size_t ChunkSize>
+FAST_ALLOCATOR_THREAD_LOCAL typename FixedAllocator<ChunkSize>::ThreadCache*
+FixedAllocator<ChunkSize>::thread_cache = nullptr;
+
+// Size classes. A request of up to FAST_ALLOCATOR_MAX_CHUNK_SIZE bytes is
+// rounded up to a multiple of FAST_ALLOCATOR_SIZE_CLASS_STEP and served by the
+// FixedAllocator of that ChunkSize. Medium requests of up to
+// FAST_ALLOCATOR_MAX_MEDIUM_SIZE bytes are rounded up to one of four sizes per
+// doubling (320, 384, 448, 512, 640 and so on with the defaults) and served
+// the same way. Bigger requests go to FastAllocatorLargeBlocks.
+#ifndef FAST_ALLOCATOR_SIZE_CLASS_STEP
+#define FAST_ALLOCATOR_SIZE_CLASS_STEP 8
+#endif
+
+#ifndef FAST_ALLOCATOR_MAX_CHUNK_SIZE
+#define FAST_ALLOCATOR_MAX_CHUNK_SIZE 256
+#endif
+
+#ifndef FAST_ALLOCATOR_MAX_MEDIUM_SIZE
+#define FAST_ALLOCATOR_MAX_MEDIUM_SIZE 4096
+#endif
+
+// Freed large blocks are cached up to this many bytes.
+#ifndef FAST_ALLOCATOR_LARGE_CACHE_BYTES
+#define FAST_ALLOCATOR_LARGE_CACHE_BYTES (64 * 1024 * 1024)
+#endif
+
+constexpr size_t FixedAllocatorFloorLog2(const size_t x) {
+  return x <= 1 ? 0 : 1 + FixedAllocatorFloorLog2(x / 2);
+}
+
+// Requests bigger than FAST_ALLOCATOR_MAX_MEDIUM_SIZE. Every block is a
+// mapping of its own, rounded up to pages and to one of four sizes per
+// doubling. Freed blocks are cached, and a request of the same rounded size
+// takes the newest of them, so that big buffers which come and go are not
+// mapped and unmapped every time.
+class FastAllocatorLargeBlocks {
+public:
+  // Blocks are aligned to pages. Smaller than or equal to the real page size,
+  // mmap rounds up anyway.
+  static const size_t kPageSize = 4096;
+
+  // Throws std::bad_alloc.
+  static void* Allocate(const size_t bytes) {
+    if (bytes > size_t(-1) / 2) {
+      throw std::bad_alloc();
+    }
+    const size_t block_size = RoundUpToBlockSize(bytes);
+    Cache& cache = GetCache();
+    {
+      std::lock_guard<FixedAllocatorMutex> lock(cache.mutex);
+      for (size_t i = cache.count; i != 0; --i) {
+        if (cache.blocks[i - 1].size == block_size) {
+          void* const memory = cache.blocks[i - 1].memory;
+          std::copy(cache.blocks + i, cache.blocks + cache.count,
+              cache.blocks + i - 1);
+          --cache.count;
+          cache.bytes -= block_size;
+          ++cache.hits;
+          return memory;
+        }
+      }
+      ++cache.misses;
+    }
+    return Map(block_size);
+  }
+
+  // bytes is the size the block was allocated with.
+  static void Deallocate(void* const memory, const size_t bytes) {
+    const size_t block_size = RoundUpToBlockSize(bytes);
+    if (block_size > kCacheBytes) {
+      Unmap(memory, block_size);
+      return;
+    }
+    // The oldest blocks make room for the new one and are unmapped outside
+    // the lock.
+    Block evicted[kCacheSlots];
+    size_t evicted_count = 0;
+    Cache& cache = GetCache();
+    {
+      std::lock_guard<FixedAllocatorMutex> lock(cache.mutex);
+      while (cache.count == kCacheSlots
+          || cache.bytes + block_size > kCacheBytes) {
+        evicted[evicted_count++] = cache.blocks[0];
+        cache.bytes -= cache.blocks[0].size;
+        std::copy(cache.blocks + 1, cache.blocks + cache.count, cache.blocks);
+        --cache.count;
+      }
+      cache.blocks[cache.count++] = Block { memory, block_size };
+      cache.bytes += block_size;
+    }
+    for (size_t i = 0; i != evicted_count; ++i) {
+      Unmap(evicted[i].memory, evicted[i].size);
+    }
+  }
+
+  // Unmaps the cached blocks. Returns the number of bytes released.
+  static size_t Trim() {
+    Block released[kCacheSlots];
+    size_t released_count;
+    size_t released_bytes;
+    Cache& cache = GetCache();
+    {
+      std::lock_guard<FixedAllocatorMutex> lock(cache.mutex);
+      std::copy(cache.blocks, cache.blocks + cache.count, released);
+      released_count = cache.count;
+      released_bytes = cache.bytes;
+      cache.count = 0;
+      cache.bytes = 0;
+    }
+    for (size_t i = 0; i != released_count; ++i) {
+      Unmap(released[i].memory, released[i].size);
+    }
+    return released_bytes;
+  }
+
+  static void GetStats(FastAllocatorStats& stats) {
+    Cache& cache = GetCache();
+    std::lock_guard<FixedAllocatorMutex> lock(cache.mutex);
+    stats.large_cached_blocks = cache.count;
+    stats.large_cached_bytes = cache.bytes;
+    stats.large_cache_hits = cache.hits;
+    stats.large_cache_misses = cache.misses;
+  }
+
+private:
+  static const size_t kCacheSlots = 32;
+  static const size_t kCacheBytes = FAST_ALLOCATOR_LARGE_CACHE_BYTES;
+
+  struct Block {
+    void* memory;
+    size_t size;
+  };
+
+  struct Cache {
+    FixedAllocatorMutex mutex;
+    // Oldest first.
+    Block blocks[kCacheSlots];
+    size_t count = 0;
+    size_t bytes = 0;
+    size_t hits = 0;
+    size_t misses = 0;
+  };
+
+  // Never destroyed, as the instances of FixedAllocator.
+  static Cache& GetCache() {
+    static Cache& cache = *new Cache();
+    return cache;
+  }
+
+  // A block of 0 bytes still takes a page, so that it has an address of its
+  // own.
+  static size_t RoundUpToBlockSize(const size_t bytes) {
+    if (bytes == 0) {
+      return kPageSize;
+    }
+    const size_t step = std::max(size_t(kPageSize),
+        (size_t(1) << FixedAllocatorFloorLog2(bytes - 1)) / 4);
+    return (bytes + step - 1) / step * step;
+  }
+
+  static void* Map(const size_t bytes) {
+#ifdef __linux__
+    void* const memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+      throw std::bad_alloc();
+    }
+    return memory;
+#elif defined(_WIN32)
+    void* const memory = _aligned_malloc(bytes, kPageSize);
+    if (memory == nullptr) {
+      throw std::bad_alloc();
+    }
+    return memory;
+#else
+    void* memory = nullptr;
+    if (posix_memalign(&memory, kPageSize, bytes) != 0) {
+      throw std::bad_alloc();
+    }
+    return memory;
+#endif
+  }
+
+  static void Unmap(void* const memory, const size_t bytes) {
+#ifdef __linux__
+    munmap(memory, bytes);
+#elif defined(_WIN32)
+    (void) bytes;
+    _aligned_free(memory);
+#else
+    (void) bytes;
+    free(memory);
+#endif
+  }
+};
+
+class FixedAllocatorInstancesOwner {
+  template<typename T, size_t MinAlignment>
+  friend class TFastAllocator;
+  friend class TFastMemoryResource;
+
+public:
+  // Pool settings of the size class which serves requests of chunk_size
+  // bytes. Requests bigger than FAST_ALLOCATOR_MAX_MEDIUM_SIZE are not pooled,
+  // the settings are ignored for them.
+  static void SetGrowthPolicy(const size_t chunk_size,
+                              const FixedAllocatorGrowthPolicy& policy) {
+    if (FixedAllocatorBase* const instance = GetInstance(chunk_size)) {
+      instance->SetGrowthPolicy(policy);
+    }
+  }
+
+  // Sets the growth policy of every size class.
+  static void SetGrowthPolicy(const FixedAllocatorGrowthPolicy& policy) {
+    for (size_t size_class = 1; size_class <= kAllSizeClassesCount;
+        ++size_class) {
+      SetGrowthPolicy(SizeClassChunkSize(size_class), policy);
+    }
+  }
+
+  // Builds pools now, so that the next chunks allocations of chunk_size bytes
+  // need no new pool.
+  static void Reserve(const size_t chunk_size, const size_t chunks) {
+    if (FixedAllocatorBase* const instance = GetInstance(chunk_size)) {
+      instance->Reserve(chunks);
+    }
+  }
+
+  // Keeps at least chunks free chunks of chunk_size bytes in the shared pool
+  // by building pools on the FixedAllocatorProvisioner thread. Without that
+  // thread running, or when it falls behind, the allocating thread builds the
+  // pool itself as usual.
+  static void SetLowWatermark(const size_t chunk_size, const size_t chunks) {
+    if (FixedAllocatorBase* const instance = GetInstance(chunk_size)) {
+      instance->SetLowWatermark(chunks);
+    }
+  }
+
+  // Takes memory for the next pools of the size class which serves requests
+  // of chunk_size bytes from backend. Pools built before keep their memory.
+  static void SetBackend(const size_t chunk_size,
+                         const FixedAllocatorBackend backend) {
+    if (FixedAllocatorBase* const instance = GetInstance(chunk_size)) {
+      instance->SetBackend(backend);
+    }
+  }
+
+  // Sets the backend of every size class.
+  static void SetBackend(const FixedAllocatorBackend backend) {
+    for (size_t size_class = 1; size_class <= kAllSizeClassesCount;
+        ++size_class) {
+      SetBackend(SizeClassChunkSize(size_class), backend);
+    }
+  }
+
+  // Snapshot of the counters of every size class and of the requests which
+  // bypass the size classes. Takes the pool lock of every size class in turn,
+  // so the size classes are not sampled at the same instant.
+  static FastAllocatorStats GetStats() {
+    FastAllocatorStats stats;
+    for (size_t size_class = 1; size_class <= kAllSizeClassesCount;
+        ++size_class) {
+      stats.size_classes.push_back(
+          GetInstance(SizeClassChunkSize(size_class))->GetStats());
+    }
+    for (size_t bucket = 0; bucket != FastAllocatorStats::kFallbackBuckets;
+        ++bucket) {
+      stats.fallback_allocations[bucket] = FallbackAllocations()[bucket].load(
+          std::memory_order_relaxed);
+      stats.fallback_deallocations[bucket] =
+          FallbackDeallocations()[bucket].load(std::memory_order_relaxed);
+    }
+    stats.numa_nodes = FixedAllocatorNuma::NodesCount();
+    FastAllocatorLargeBlocks::GetStats(stats);
+    return stats;
+  }
+
+#ifdef FAST_ALLOCATOR_TRACE
+  // Pool builds of all size classes, the last
+  // FixedAllocatorPoolEvents::kCapacity of them.
+  static std::vector<FixedAllocatorPoolEvent> GetPoolEvents() {
+    return FixedAllocatorPoolEvents::Instance().Snapshot();
+  }
+
+  // Prints the latency histograms of the size classes which were used and
+  // the pool events.
+  static void DumpTrace(std::ostream& out) {
+    for (size_t size_class = 1; size_class <= kAllSizeClassesCount;
+        ++size_class) {
+      FixedAllocatorBase* const instance = GetInstance(
+          SizeClassChunkSize(size_class));
+      if (instance->GetStats().pools_count != 0) {
+        instance->DumpLatencies(out);
+      }
+    }
+    static const char* const kCauses[] = { "on_demand", "reserve",
+        "provision" };
+    for (const auto& event : GetPoolEvents()) {
+      out << "pool timestamp_ns=" << event.timestamp_ns << " duration_ns="
+          << event.duration_ns << " chunk_size=" << event.chunk_size
+          << " bytes=" << event.pool_bytes << " cause="
+          << kCauses[event.cause] << "\n";
+    }
+  }
+#endif
+
+  // Gives pools without chunks in use and the cached large blocks back to the
+  // system, keeping the low watermarks. Chunks cached by other running threads
+  // stay in use until those threads release them. Returns the number of bytes
+  // released.
+  static size_t Trim() {
+    size_t released_bytes = FastAllocatorLargeBlocks::Trim();
+    for (size_t size_class = 1; size_class <= kAllSizeClassesCount;
+        ++size_class) {
+      released_bytes += GetInstance(SizeClassChunkSize(size_class))->Trim();
+    }
+    return released_bytes;
+  }
+
+  // With auto trim enabled, a size class gives free pools back to the system
+  // as soon as they hold more than twice retained_chunks spare chunks, down to
+  // retained_chunks.
+  static void SetAutoTrim(const bool enabled,
+                          const size_t retained_chunks = 0) {
+    for (size_t size_class = 1; size_class <= kAllSizeClassesCount;
+        ++size_class) {
+      GetInstance(SizeClassChunkSize(size_class))->SetAutoTrim(enabled,
+          retained_chunks);
+    }
+  }
+
+private:
+  static const size_t kSizeClassStep = FAST_ALLOCATOR_SIZE_CLASS_STEP;
+  static const size_t kMaxChunkSize = FAST_ALLOCATOR_MAX_CHUNK_SIZE;
+  static const size_t kSizeClassesCount = kMaxChunkSize / kSizeClassStep;
+  static const size_t kMaxMediumSize = FAST_ALLOCATOR_MAX_MEDIUM_SIZE;
+  static const size_t kMediumClassesPerDoubling = 4;
+  static const size_t kMediumClassesCount = kMediumClassesPerDoubling
+      * FixedAllocatorFloorLog2(kMaxMediumSize / kMaxChunkSize);
+  static const size_t kAllSizeClassesCount = kSizeClassesCount
+      + kMediumClassesCount;
+  // Medium classes get pools of about this many bytes by default.
+  static const size_t kMediumPoolBytes = 8 * 1024 * 1024;
+
+  static_assert((kSizeClassStep & (kSizeClassStep - 1)) == 0
+      && kSizeClassStep >= sizeof(void*),
+      "FAST_ALLOCATOR_SIZE_CLASS_STEP must be a power of 2 not less than the pointer size");
+  static_assert(kMaxChunkSize % kSizeClassStep == 0,
+      "FAST_ALLOCATOR_MAX_CHUNK_SIZE must be a multiple of FAST_ALLOCATOR_SIZE_CLASS_STEP");
+  static_assert(kMaxMediumSize >= kMaxChunkSize
+      && kMaxMediumSize % kMaxChunkSize == 0
+      && ((kMaxMediumSize / kMaxChunkSize)
+          & (kMaxMediumSize / kMaxChunkSize - 1)) == 0,
+      "FAST_ALLOCATOR_MAX_MEDIUM_SIZE must be FAST_ALLOCATOR_MAX_CHUNK_SIZE times a power of 2");
+  static_assert(kMediumClassesCount == 0
+      || kMaxChunkSize % (kMediumClassesPerDoubling * kSizeClassStep) == 0,
+      "FAST_ALLOCATOR_MAX_CHUNK_SIZE must be a multiple of 4 * FAST_ALLOCATOR_SIZE_CLASS_STEP for the medium classes");
+
+  // instances[i] serves requests of
+  // (SizeClassChunkSize(i - 1), SizeClassChunkSize(i)] bytes; instances[0]
+  // serves empty requests.
+  typedef FixedAllocatorBase* InstancesTable[kAllSizeClassesCount + 1];
+
+  // Chunk size of the size class, 1 <= size_class <= kAllSizeClassesCount.
+  static constexpr size_t SizeClassChunkSize(const size_t size_class) {
+    return size_class <= kSizeClassesCount ?
+        size_class * kSizeClassStep :
+        MediumChunkSize(size_class - kSizeClassesCount - 1);
+  }
+
+  static constexpr size_t MediumChunkSize(const size_t medium_class) {
+    return (kMaxChunkSize << medium_class / kMediumClassesPerDoubling)
+        / kMediumClassesPerDoubling * (kMediumClassesPerDoubling + 1
+        + medium_class % kMediumClassesPerDoubling);
+  }
+
+  // Size class of a request of up to kMaxMediumSize bytes.
+  static constexpr size_t SizeClassOf(const size_t bytes) {
+    return bytes <= kMaxChunkSize ?
+        (bytes + kSizeClassStep - 1) / kSizeClassStep :
+        kSizeClassesCount + 1 + MediumClassOf(bytes,
+            FixedAllocatorFloorLog2((bytes - 1) / kMaxChunkSize));
+  }
+
+  // doubling is the number of times bytes - 1 doubles kMaxChunkSize.
+  static constexpr size_t MediumClassOf(const size_t bytes,
+                                        const size_t doubling) {
+    return doubling * kMediumClassesPerDoubling + (bytes - 1)
+        / ((kMaxChunkSize << doubling) / kMediumClassesPerDoubling)
+        - kMediumClassesPerDoubling;
+  }
+
+  static constexpr size_t RoundUpToSizeClass(const size_t bytes) {
+    return bytes == 0 ?
+        kSizeClassStep : SizeClassChunkSize(SizeClassOf(bytes));
+  }
+
+  // Alignment of the chunks which serve requests of bytes: chunks start at a
+  // cache line boundary of a span and follow each other, so they are aligned
+  // to the lowest power of 2 of the chunk size, up to kCacheLineSize.
+  static constexpr size_t ChunkAlignment(const size_t bytes) {
+    return (RoundUpToSizeClass(bytes) & (0 - RoundUpToSizeClass(bytes)))
+        < FixedAllocatorBase::kCacheLineSize ?
+        (RoundUpToSizeClass(bytes) & (0 - RoundUpToSizeClass(bytes))) :
+        FixedAllocatorBase::kCacheLineSize;
+  }
+
+  // A request of bytes aligned to alignment is served as a request of bytes
+  // rounded up to a multiple of alignment, so alignment is a part of the
+  // size class key. The size class of the rounded size is then a multiple
+  // of alignment as well, unless alignment exceeds kCacheLineSize or the
+  // medium classes are coarser than alignment.
+  static constexpr size_t AlignedRequestSize(const size_t bytes,
+                                             const size_t alignment) {
+    return (bytes + alignment - 1) / alignment * alignment;
+  }
+
+  // Whether a size class serves aligned_bytes, see AlignedRequestSize, at
+  // alignment.
+  static constexpr bool IsPooled(const size_t aligned_bytes,
+                                 const size_t alignment) {
+    return aligned_bytes <= kMaxMediumSize
+        && alignment <= ChunkAlignment(aligned_bytes);
+  }
+
+  // Instances are never destroyed, so lists with static storage duration
+  // and threads which outlive main() can still release their chunks.
+  template<size_t ChunkSize>
+  static FixedAllocator<ChunkSize>& GetInstance() {
+    static FixedAllocator<ChunkSize>& instance = *new FixedAllocator<ChunkSize>(
+        FixedAllocatorGrowthPolicy::Fixed(ChunkSize <= kMaxChunkSize ?
+            100000 : kMediumPoolBytes / ChunkSize));
+    return instance;
+  }
+
+  template<size_t SizeClass, bool = SizeClass == 0>
+  struct InstancesTableFiller {
+    static void Fill(InstancesTable& instances) {
+      instances[SizeClass] = &GetInstance<SizeClassChunkSize(SizeClass)>();
+      InstancesTableFiller<SizeClass - 1>::Fill(instances);
+    }
+  };
+
+  template<size_t SizeClass>
+  struct InstancesTableFiller<SizeClass, true> {
+    static void Fill(InstancesTable& instances) {
+      instances[0] = instances[1];
+    }
+  };
+
+  struct Instances {
+    InstancesTable table;
+
+    Instances() {
+      InstancesTableFiller<kAllSizeClassesCount>::Fill(table);
+    }
+  };
+
+  static FixedAllocatorBase* GetInstance(const size_t chunk_size) {
+    static Instances instances;
+    if (chunk_size > kMaxMediumSize) {
+      return nullptr;
+    }
+    return instances.table[SizeClassOf(chunk_size)];
+  }
+
+  // The size class which serves requests of bytes aligned to alignment, a
+  // power of 2, or nullptr if there is none.
+  static FixedAllocatorBase* GetInstance(const size_t bytes,
+                                         const size_t alignment) {
+    if (bytes > kMaxMediumSize) {
+      return nullptr;
+    }
+    const size_t aligned_bytes = AlignedRequestSize(bytes, alignment);
+    return IsPooled(aligned_bytes, alignment) ?
+        GetInstance(aligned_bytes) : nullptr;
+  }
+
+  typedef std::atomic<size_t> FallbackCounters[
+      FastAllocatorStats::kFallbackBuckets];
+
+  static FallbackCounters& FallbackAllocations() {
+    static FallbackCounters counters;
+    return counters;
+  }
+
+  static FallbackCounters& FallbackDeallocations() {
+    static FallbackCounters counters;
+    return counters;
+  }
+
+  static void CountFallback(FallbackCounters& counters, const size_t bytes) {
+    // Requests of more than kMaxMediumSize bytes come here, and the ones
+    // aligned above what their size class guarantees, down to 0 bytes.
+    size_t bucket = 0;
+    for (size_t rest = bytes == 0 ? 0 : bytes - 1; rest != 0; rest >>= 1) {
+      ++bucket;
+    }
+    counters[bucket].fetch_add(1, std::memory_order_relaxed);
+  }
+};
+
+// Memory for objects of type T aligned to at least MinAlignment, a power of 2
+// up to FastAllocatorLargeBlocks::kPageSize (alignof(T) if 0). Alignments up
+// to FixedAllocatorBase::kCacheLineSize are served by the size classes,
+// bigger ones by the large blocks.
+template<typename T, size_t MinAlignment>
+class TFastAllocator {
+public:
+  typedef T value_type;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+
+  template<typename U>
+  struct rebind {
+    typedef TFastAllocator<U, MinAlignment> other;
+  };
+
+  TFastAllocator() {
+  }
+
+  template<typename U, size_t OtherMinAlignment>
+  TFastAllocator(const TFastAllocator<U, OtherMinAlignment>&) {
+  }
+
+  pointer address(reference r) const {
+    return &r;
+  }
+
+  const_pointer address(const_reference r) const {
+    return &r;
+  }
+
+  pointer allocate(size_type n) {
+    if (n == 1) {
+      return static_cast<pointer>(AllocateOne(IsPooled()));
+    }
+    return static_cast<pointer>(AllocateBytes(n * sizeof(value_type)));
+  }
+
+  void deallocate(pointer p, size_type n) {
+    if (n == 1) {
+      DeallocateOne(static_cast<void*>(p), IsPooled());
+    } else {
+      DeallocateBytes(static_cast<void*>(p), n * sizeof(value_type));
+    }
+  }
+
+  // Allocates count single objects at once, objects[i] gets one of them.
+  // Cheaper than count calls of allocate(1). On failure nothing is allocated.
+  void allocate_batch(pointer* objects, size_type count) {
+    AllocateBatch(objects, count, IsPooled());
+  }
+
+  // Deallocates count single objects allocated by allocate(1) or
+  // allocate_batch.
+  void deallocate_batch(pointer* objects, size_type count) {
+    DeallocateBatch(objects, count, IsPooled());
+  }
+
+  // Deallocates count single objects linked into a chain: the object first
+  // starts with a pointer to the next one, and so on up to last. Used by
+  // containers whose nodes start with the link to the next node, which can
+  // give a whole range of nodes back in O(1) this way.
+  void deallocate_chain(pointer first, pointer last, size_type count) {
+    DeallocateChain(first, last, count, IsPooled());
+  }
+
+  template<typename ... Args>
+  void construct(pointer p, Args&& ... args) {
+    new (p) T(std::forward<Args>(args)...);
+  }
+
+  void destroy(pointer p) {
+    p->~T();
+  }
+
+  size_type max_size() const noexcept {
+    return size_t(-1) / sizeof(value_type);
+  }
+
+private:
+  static const size_t kAlignment = alignof(value_type) > MinAlignment ?
+      alignof(value_type) : MinAlignment;
+  // Size class key of single objects.
+  static const size_t kObjectBytes =
+      FixedAllocatorInstancesOwner::AlignedRequestSize(sizeof(value_type),
+          kAlignment);
+
+  static_assert((kAlignment & (kAlignment - 1)) == 0
+      && kAlignment <= FastAllocatorLargeBlocks::kPageSize,
+      "MinAlignment must be a power of 2 not bigger than the page size");
+
+  // Whether single objects are served by a FixedAllocator. If so, that one is
+  // bound at compile time and called without the size lookup and the virtual
+  // call of the array path.
+  typedef std::integral_constant<bool,
+      FixedAllocatorInstancesOwner::IsPooled(kObjectBytes, kAlignment)>
+      IsPooled;
+
+  static FixedAllocator<
+      FixedAllocatorInstancesOwner::RoundUpToSizeClass(kObjectBytes)>&
+  GetFixedAllocator() {
+    return FixedAllocatorInstancesOwner::GetInstance<
+        FixedAllocatorInstancesOwner::RoundUpToSizeClass(kObjectBytes)>();
+  }
+
+  static void* AllocateOne(std::true_type) {
+    return GetFixedAllocator().GiveChunk();
+  }
+
+  static void* AllocateOne(std::false_type) {
+    return AllocateBytes(sizeof(value_type));
+  }
+
+  static void DeallocateOne(void* raw_pointer, std::true_type) {
+    GetFixedAllocator().ReleaseChunk(raw_pointer);
+  }
+
+  static void DeallocateOne(void* raw_pointer, std::false_type) {
+    DeallocateBytes(raw_pointer, sizeof(value_type));
+  }
+
+  static void AllocateBatch(pointer* objects,
+                            const size_type count,
+                            std::true_type) {
+    GetFixedAllocator().GiveChunks(objects, count);
+  }
+
+  static void AllocateBatch(pointer* objects,
+                            const size_type count,
+                            std::false_type) {
+    size_type allocated = 0;
+    try {
+      for (; allocated != count; ++allocated) {
+        objects[allocated] = static_cast<pointer>(AllocateOne(
+            std::false_type()));
+      }
+    } catch (...) {
+      DeallocateBatch(objects, allocated, std::false_type());
+      throw;
+    }
+  }
+
+  static void DeallocateBatch(pointer* objects,
+                              const size_type count,
+                              std::true_type) {
+    GetFixedAllocator().ReleaseChunks(objects, count);
+  }
+
+  static void DeallocateBatch(pointer* objects,
+                              const size_type count,
+                              std::false_type) {
+    for (size_type i = 0; i != count; ++i) {
+      DeallocateOne(static_cast<void*>(objects[i]), std::false_type());
+    }
+  }
+
+  static void DeallocateChain(pointer first,
+                              pointer last,
+                              const size_type count,
+                              std::true_type) {
+    GetFixedAllocator().ReleaseChain(static_cast<void*>(first),
+        static_cast<void*>(last), count);
+  }
+
+  static void DeallocateChain(pointer first,
+                              pointer,
+                              size_type count,
+                              std::false_type) {
+    for (; count != 0; --count) {
+      pointer const next = *reinterpret_cast<pointer*>(first);
+      DeallocateOne(static_cast<void*>(first), std::false_type());
+      first = next;
+    }
+  }
+
+  static void* AllocateBytes(const size_t bytes_to_allocate) {
+    auto fixed_allocator = FixedAllocatorInstancesOwner::GetInstance(
+        bytes_to_allocate, kAlignment);
+    if (fixed_allocator == nullptr) {
+      // Too big or too aligned for the size classes.
+      FixedAllocatorInstancesOwner::CountFallback(
+          FixedAllocatorInstancesOwner::FallbackAllocations(),
+          bytes_to_allocate);
+      return FastAllocatorLargeBlocks::Allocate(bytes_to_allocate);
+    }
+
+    return fixed_allocator->GiveChunk();
+  }
+
+  static void DeallocateBytes(void* raw_pointer,
+                              const size_t bytes_to_deallocate) {
+    auto fixed_allocator = FixedAllocatorInstancesOwner::GetInstance(
+        bytes_to_deallocate, kAlignment);
+    if (fixed_allocator == nullptr) {
+      FixedAllocatorInstancesOwner::CountFallback(
+          FixedAllocatorInstancesOwner::FallbackDeallocations(),
+          bytes_to_deallocate);
+      FastAllocatorLargeBlocks::Deallocate(raw_pointer, bytes_to_deallocate);
+    } else {
+      fixed_allocator->ReleaseChunk(raw_pointer);
+    }
+  }
+};
+
+// All TFastAllocators share the same FixedAllocators, so memory allocated by
+// one of them can be freed by any other of the same alignment.
+template<typename T, size_t MinAlignment, typename U, size_t OtherMinAlignment>
+inline bool operator==(const TFastAllocator<T, MinAlignment>&,
+                       const TFastAllocator<U, OtherMinAlignment>&) {
+  return MinAlignment == OtherMinAlignment;
+}
+
+template<typename T, size_t MinAlignment, typename U, size_t OtherMinAlignment>
+inline bool operator!=(const TFastAllocator<T, MinAlignment>& x,
+                       const TFastAllocator<U, OtherMinAlignment>& y) {
+  return !(x == y);
+}
+
+// Pads and aligns every object to a cache line, so that objects written by
+// different threads, e.g. nodes of per-thread lists, never share one.
+template<typename T>
+using TCacheAlignedAllocator = TFastAllocator<T,
+    FixedAllocatorBase::kCacheLineSize>;
+
+#endif /* FAST_ALLOCATOR_H_ */
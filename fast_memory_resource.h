@@ -0,0 +1,73 @@
+/*
+ * fast_memory_resource.h
+ *
+ * std::pmr::memory_resource over the fixed-size pools of TFastAllocator, so
+ * that std::pmr containers and TPmrList take their small blocks from the
+ * pools. Needs C++17.
+ */
+
+#ifndef FAST_MEMORY_RESOURCE_H_
+#define FAST_MEMORY_RESOURCE_H_
+
+#include <cstddef>
+#include <memory_resource>
+
+#include "fast_allocator.h"
+
+// Requests of up to FAST_ALLOCATOR_MAX_MEDIUM_SIZE bytes go to the pools of
+// TFastAllocator, bigger or over-aligned ones to the upstream resource. The
+// pools are shared by the whole process, so the resource itself holds only
+// the upstream pointer, and any two resources with equal upstreams can free
+// each other's memory.
+class TFastMemoryResource : public std::pmr::memory_resource {
+public:
+  explicit TFastMemoryResource(std::pmr::memory_resource* const upstream =
+                                   std::pmr::get_default_resource())
+      : upstream(upstream) {
+  }
+
+  TFastMemoryResource(const TFastMemoryResource& other) = delete;
+
+  TFastMemoryResource& operator=(const TFastMemoryResource& other) = delete;
+
+  std::pmr::memory_resource* upstream_resource() const {
+    return upstream;
+  }
+
+private:
+  static FixedAllocatorBase* GetPool(const size_t bytes,
+                                     const size_t alignment) {
+    return FixedAllocatorInstancesOwner::GetInstance(bytes, alignment);
+  }
+
+  void* do_allocate(const size_t bytes, const size_t alignment) override {
+    if (FixedAllocatorBase* const pool = GetPool(bytes, alignment)) {
+      return pool->GiveChunk();
+    }
+    return upstream->allocate(bytes, alignment);
+  }
+
+  void do_deallocate(void* const ptr,
+                     const size_t bytes,
+                     const size_t alignment) override {
+    if (FixedAllocatorBase* const pool = GetPool(bytes, alignment)) {
+      pool->ReleaseChunk(ptr);
+    } else {
+      upstream->deallocate(ptr, bytes, alignment);
+    }
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept
+      override {
+    if (this == &other) {
+      return true;
+    }
+    const TFastMemoryResource* const fast_other =
+        dynamic_cast<const TFastMemoryResource*>(&other);
+    return fast_other != nullptr && *upstream == *fast_other->upstream;
+  }
+
+  std::pmr::memory_resource* const upstream;
+};
+
+#endif /* FAST_MEMORY_RESOURCE_H_ */
@@ -0,0 +1,723 @@
+/*
+ * forward_list.h
+ *
+ * TForwardList: a singly linked list for lists which are appended to and
+ * scanned forward only. A node has no prev pointer, so ForwardListNode<int>
+ * takes 16 bytes instead of the 24 of ListNode<int> and falls into the 16-byte
+ * size class of TFastAllocator. The list keeps a pointer to its last node for
+ * push_back.
+ */
+
+#ifndef FORWARD_LIST_H_
+#define FORWARD_LIST_H_
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "fast_allocator.h"
+#include "lst.h"
+
+// next comes first, so nodes linked through next are also linked through their
+// first bytes, as TFastAllocator::deallocate_chain expects.
+struct ForwardListNodeBase {
+  ForwardListNodeBase* next;
+
+  ForwardListNodeBase()
+      : next(nullptr) {
+  }
+};
+
+template<typename T>
+struct ForwardListNode : public ForwardListNodeBase {
+  T data;
+
+  template<typename ... Args>
+  ForwardListNode(Args&&... args)
+      : data(std::forward<Args>(args)...) {
+  }
+};
+
+template<typename T>
+struct ForwardListIterator {
+  typedef ForwardListNode<T> Node;
+
+  typedef ptrdiff_t difference_type;
+  typedef std::forward_iterator_tag iterator_category;
+  typedef T value_type;
+  typedef T* pointer;
+  typedef T& reference;
+
+  ForwardListNodeBase* ptr;
+
+  ForwardListIterator(ForwardListNodeBase* const ptr)
+      : ptr(ptr) {
+  }
+
+  reference operator*() const {
+    return static_cast<Node*>(ptr)->data;
+  }
+
+  pointer operator->() const {
+    return &static_cast<Node*>(ptr)->data;
+  }
+
+  ForwardListIterator& operator++() {
+    ptr = ptr->next;
+    return *this;
+  }
+
+  ForwardListIterator operator++(int) {
+    ForwardListIterator tmp = *this;
+    ptr = ptr->next;
+    return tmp;
+  }
+
+  bool operator==(const ForwardListIterator& other) const {
+    return ptr == other.ptr;
+  }
+
+  bool operator!=(const ForwardListIterator& other) const {
+    return ptr != other.ptr;
+  }
+};
+
+template<typename T>
+struct ForwardListConstIterator {
+  typedef const ForwardListNode<T> Node;
+  typedef ForwardListIterator<T> iterator;
+
+  typedef ptrdiff_t difference_type;
+  typedef std::forward_iterator_tag iterator_category;
+  typedef T value_type;
+  typedef const T* pointer;
+  typedef const T& reference;
+
+  const ForwardListNodeBase* ptr;
+
+  ForwardListConstIterator(const ForwardListNodeBase* const ptr)
+      : ptr(ptr) {
+  }
+
+  ForwardListConstIterator(const iterator& other)
+      : ptr(other.ptr) {
+  }
+
+  reference operator*() const {
+    return static_cast<Node*>(ptr)->data;
+  }
+
+  pointer operator->() const {
+    return &static_cast<Node*>(ptr)->data;
+  }
+
+  ForwardListConstIterator& operator++() {
+    ptr = ptr->next;
+    return *this;
+  }
+
+  ForwardListConstIterator operator++(int) {
+    ForwardListConstIterator tmp = *this;
+    ptr = ptr->next;
+    return tmp;
+  }
+
+  bool operator==(const ForwardListConstIterator& other) const {
+    return ptr == other.ptr;
+  }
+
+  bool operator!=(const ForwardListConstIterator& other) const {
+    return ptr != other.ptr;
+  }
+};
+
+// The interface of std::forward_list (positions are before the elements
+// concerned, end() is a null iterator), plus size(), back() and push_back in
+// O(1). Nodes come from the fixed-size pools of TFastAllocator by default.
+template<typename T, typename Allocator = TFastAllocator<T>>
+class TForwardList : private std::allocator_traits<Allocator>::
+    template rebind_alloc<ForwardListNode<T>> {
+public:
+  typedef T value_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef ForwardListIterator<T> iterator;
+  typedef ForwardListConstIterator<T> const_iterator;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+  typedef Allocator allocator_type;
+
+private:
+  typedef typename std::allocator_traits<Allocator>::template rebind_alloc<
+      ForwardListNode<value_type>> NodesAllocator;
+  typedef std::allocator_traits<NodesAllocator> NodesTraits;
+
+public:
+  TForwardList(const allocator_type& alloc = allocator_type())
+      : NodesAllocator(alloc) {
+  }
+
+  // Strong guarantees (no changes in case of exception, i. e. all would be destroyed)
+  TForwardList(const TForwardList& x)
+      : NodesAllocator(NodesTraits::select_on_container_copy_construction(
+            x.GetAllocator())) {
+    try {
+      for (const auto& value : x) {
+        emplace_back(value);
+      }
+    } catch (...) {
+      clear();
+      throw;
+    }
+  }
+
+  TForwardList(TForwardList&& x)
+      : NodesAllocator(std::move(x.GetAllocator())) {
+    SwapNodes(x);
+  }
+
+  // Strong guarantees (no changes in case of exception, i. e. all would be destroyed)
+  template<class InputIterator, typename = typename std::enable_if<
+      std::is_convertible<typename std::iterator_traits<
+          InputIterator>::iterator_category, std::input_iterator_tag>::value>
+      ::type>
+  TForwardList(InputIterator first,
+               InputIterator last,
+               const allocator_type& alloc = allocator_type())
+      : NodesAllocator(alloc) {
+    try {
+      for (; first != last; ++first) {
+        emplace_back(*first);
+      }
+    } catch (...) {
+      clear();
+      throw;
+    }
+  }
+
+  ~TForwardList() {
+    clear();
+  }
+
+  // Basic guarantees (no memory leak)
+  TForwardList& operator=(const TForwardList& x) {
+    if (this != &x) {
+      // Nodes of this list can be given back only to its own allocator.
+      clear();
+      CopyAllocator(x.GetAllocator(), std::integral_constant<bool,
+          NodesTraits::propagate_on_container_copy_assignment::value>());
+      for (const auto& value : x) {
+        emplace_back(value);
+      }
+    }
+    return *this;
+  }
+
+  // The nodes of x are taken over if the allocator propagates or the
+  // allocators are equal, otherwise the elements are moved one by one.
+  TForwardList& operator=(TForwardList&& x) {
+    if (this != &x) {
+      clear();
+      if (NodesTraits::propagate_on_container_move_assignment::value
+          || GetAllocator() == x.GetAllocator()) {
+        MoveAllocator(x.GetAllocator(), std::integral_constant<bool,
+            NodesTraits::propagate_on_container_move_assignment::value>());
+        SwapNodes(x);
+      } else {
+        for (auto& value : x) {
+          emplace_back(std::move(value));
+        }
+        x.clear();
+      }
+    }
+    return *this;
+  }
+
+  iterator before_begin() {
+    return iterator(&base_);
+  }
+
+  const_iterator before_begin() const {
+    return const_iterator(&base_);
+  }
+
+  const_iterator cbefore_begin() const {
+    return const_iterator(&base_);
+  }
+
+  iterator begin() {
+    return iterator(base_.next);
+  }
+
+  const_iterator begin() const {
+    return const_iterator(base_.next);
+  }
+
+  const_iterator cbegin() const {
+    return const_iterator(base_.next);
+  }
+
+  iterator end() {
+    return iterator(nullptr);
+  }
+
+  const_iterator end() const {
+    return const_iterator(nullptr);
+  }
+
+  const_iterator cend() const {
+    return const_iterator(nullptr);
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  allocator_type get_allocator() const {
+    return allocator_type(GetAllocator());
+  }
+
+  reference front() {
+    return *begin();
+  }
+
+  const_reference front() const {
+    return *begin();
+  }
+
+  reference back() {
+    return *iterator(tail_);
+  }
+
+  const_reference back() const {
+    return *const_iterator(tail_);
+  }
+
+  // Strong guarantees (no changes in case of exception)
+  template<typename ... Args>
+  void emplace_front(Args&&... args) {
+    LinkAfter(&base_, CreateNode(std::forward<Args>(args)...));
+  }
+
+  // Strong guarantees (no changes in case of exception)
+  template<typename ... Args>
+  void emplace_back(Args&&... args) {
+    LinkAfter(tail_, CreateNode(std::forward<Args>(args)...));
+  }
+
+  void push_front(const value_type& val) {
+    emplace_front(val);
+  }
+
+  void push_front(value_type&& val) {
+    emplace_front(std::move(val));
+  }
+
+  void push_back(const value_type& val) {
+    emplace_back(val);
+  }
+
+  void push_back(value_type&& val) {
+    emplace_back(std::move(val));
+  }
+
+  void pop_front() noexcept {
+    erase_after(before_begin());
+  }
+
+  // Strong guarantees (no changes in case of exception)
+  template<typename ... Args>
+  iterator emplace_after(const_iterator position, Args&&... args) {
+    ForwardListNodeBase* const node =
+        CreateNode(std::forward<Args>(args)...);
+    LinkAfter(const_cast<ForwardListNodeBase*>(position.ptr), node);
+    return iterator(node);
+  }
+
+  iterator insert_after(const_iterator position, const value_type& val) {
+    return emplace_after(position, val);
+  }
+
+  iterator insert_after(const_iterator position, value_type&& val) {
+    return emplace_after(position, std::move(val));
+  }
+
+  // Returns an iterator to the last inserted element, or position if none.
+  // Strong guarantees (no changes in case of exception)
+  template<class InputIterator, typename = typename std::enable_if<
+      std::is_convertible<typename std::iterator_traits<
+          InputIterator>::iterator_category, std::input_iterator_tag>::value>
+      ::type>
+  iterator insert_after(const_iterator position,
+                        InputIterator first,
+                        InputIterator last) {
+    // The nodes are linked aside and put into the list at once.
+    ForwardListNodeBase head;
+    ForwardListNodeBase* chain_tail = &head;
+    size_type count = 0;
+    try {
+      for (; first != last; ++first) {
+        chain_tail->next = CreateNode(*first);
+        chain_tail = chain_tail->next;
+        ++count;
+      }
+    } catch (...) {
+      ReleaseNodes(head.next, chain_tail, count);
+      throw;
+    }
+    ForwardListNodeBase* const position_ptr =
+        const_cast<ForwardListNodeBase*>(position.ptr);
+    if (count != 0) {
+      chain_tail->next = position_ptr->next;
+      position_ptr->next = head.next;
+      if (tail_ == position_ptr) {
+        tail_ = chain_tail;
+      }
+      size_ += count;
+    }
+    return iterator(chain_tail == &head ? position_ptr : chain_tail);
+  }
+
+  // Erases the element after position, returns the one after it.
+  iterator erase_after(const_iterator position) noexcept {
+    ForwardListNodeBase* const position_ptr =
+        const_cast<ForwardListNodeBase*>(position.ptr);
+    ForwardListNodeBase* const node = position_ptr->next;
+    position_ptr->next = node->next;
+    if (tail_ == node) {
+      tail_ = position_ptr;
+    }
+    --size_;
+    ReleaseNodes(node, node, 1);
+    return iterator(position_ptr->next);
+  }
+
+  // Erases the elements in (position, last), returns last.
+  iterator erase_after(const_iterator position,
+                       const_iterator last) noexcept {
+    ForwardListNodeBase* const position_ptr =
+        const_cast<ForwardListNodeBase*>(position.ptr);
+    ForwardListNodeBase* const last_ptr =
+        const_cast<ForwardListNodeBase*>(last.ptr);
+    ForwardListNodeBase* const first = position_ptr->next;
+    if (first != last_ptr) {
+      ForwardListNodeBase* last_erased = first;
+      size_type count = 1;
+      while (last_erased->next != last_ptr) {
+        last_erased = last_erased->next;
+        ++count;
+      }
+      position_ptr->next = last_ptr;
+      if (last_ptr == nullptr) {
+        tail_ = position_ptr;
+      }
+      size_ -= count;
+      ReleaseNodes(first, last_erased, count);
+    }
+    return iterator(last_ptr);
+  }
+
+  void clear() noexcept {
+    if (size_ != 0) {
+      ReleaseNodes(base_.next, tail_, size_);
+    }
+    base_.next = nullptr;
+    tail_ = &base_;
+    size_ = 0;
+  }
+
+  // Moves all elements of x after position. The allocators must be equal.
+  // Strong guarantees (no changes in case of exception)
+  void splice_after(const_iterator position, TForwardList&& x) noexcept {
+    if (!x.empty()) {
+      Transfer(position, x, &x.base_, x.tail_, x.size_);
+    }
+  }
+
+  void splice_after(const_iterator position, TForwardList& x) noexcept {
+    splice_after(position, std::move(x));
+  }
+
+  // Moves the element of x after i.
+  void splice_after(const_iterator position,
+                    TForwardList&& x,
+                    const_iterator i) noexcept {
+    const ForwardListNodeBase* const node = i.ptr->next;
+    if (position.ptr != i.ptr && position.ptr != node) {
+      Transfer(position, x, const_cast<ForwardListNodeBase*>(i.ptr),
+          const_cast<ForwardListNodeBase*>(node), 1);
+    }
+  }
+
+  void splice_after(const_iterator position,
+                    TForwardList& x,
+                    const_iterator i) noexcept {
+    splice_after(position, std::move(x), i);
+  }
+
+  // Moves the elements of x in (first, last) after position.
+  void splice_after(const_iterator position,
+                    TForwardList&& x,
+                    const_iterator first,
+                    const_iterator last) noexcept {
+    ForwardListNodeBase* const first_ptr =
+        const_cast<ForwardListNodeBase*>(first.ptr);
+    if (first_ptr->next == last.ptr) {
+      return;
+    }
+    ForwardListNodeBase* last_moved = first_ptr->next;
+    size_type count = 1;
+    while (last_moved->next != last.ptr) {
+      last_moved = last_moved->next;
+      ++count;
+    }
+    Transfer(position, x, first_ptr, last_moved, count);
+  }
+
+  void splice_after(const_iterator position,
+                    TForwardList& x,
+                    const_iterator first,
+                    const_iterator last) noexcept {
+    splice_after(position, std::move(x), first, last);
+  }
+
+  void merge(TForwardList&& x) {
+    merge(std::move(x), ElementsLess());
+  }
+
+  void merge(TForwardList& x) {
+    merge(std::move(x), ElementsLess());
+  }
+
+  // Moves the nodes of x into the list, both sorted by comp, in one pass.
+  // Elements of the list go first among equal ones. The allocators must be
+  // equal.
+  // If a comparison throws, all elements are in this list in some order and
+  // x is empty.
+  template<typename Compare>
+  void merge(TForwardList&& x, Compare comp) {
+    if (this == &x || x.empty()) {
+      return;
+    }
+    const NodesLess<Compare> less(comp);
+    // The last node is known beforehand, so the list need not be walked.
+    ForwardListNodeBase* const new_tail =
+        !empty() && less(x.tail_, tail_) ? tail_ : x.tail_;
+    size_ += x.size_;
+    x.size_ = 0;
+    x.tail_ = &x.base_;
+    try {
+      ListChains::MergeInto(base_.next, x.base_.next, less);
+    } catch (...) {
+      tail_ = FindTail();
+      throw;
+    }
+    tail_ = new_tail;
+  }
+
+  template<typename Compare>
+  void merge(TForwardList& x, Compare comp) {
+    merge(std::move(x), comp);
+  }
+
+  // Stable merge sort of the nodes in place, as TList::sort: nothing is
+  // allocated, copied or moved. The list is walked once more afterwards to
+  // find its last node.
+  // If a comparison throws, all elements stay in the list in some order.
+  void sort() {
+    sort(ElementsLess());
+  }
+
+  template<typename Compare>
+  void sort(Compare comp) {
+    if (size_ < 2) {
+      return;
+    }
+    try {
+      ListChains::SortChain(base_.next, NodesLess<Compare>(comp));
+    } catch (...) {
+      tail_ = FindTail();
+      throw;
+    }
+    tail_ = FindTail();
+  }
+
+  // The allocators are swapped only if they propagate on swap, otherwise
+  // they must be equal.
+  void swap(TForwardList& x) {
+    SwapNodes(x);
+    SwapAllocators(x, std::integral_constant<bool,
+        NodesTraits::propagate_on_container_swap::value>());
+  }
+
+private:
+  // operator< of the elements, what sort() and merge() use by default.
+  struct ElementsLess {
+    bool operator()(const value_type& x, const value_type& y) const {
+      return x < y;
+    }
+  };
+
+  // Compares nodes by their elements.
+  template<typename Compare>
+  struct NodesLess {
+    explicit NodesLess(Compare& comp)
+        : comp(comp) {
+    }
+
+    bool operator()(ForwardListNodeBase* const x,
+                    ForwardListNodeBase* const y) const {
+      return comp(static_cast<ForwardListNode<value_type>*>(x)->data,
+          static_cast<ForwardListNode<value_type>*>(y)->data);
+    }
+
+    Compare& comp;
+  };
+
+  NodesAllocator& GetAllocator() {
+    return *static_cast<NodesAllocator*>(this);
+  }
+
+  const NodesAllocator& GetAllocator() const {
+    return *static_cast<const NodesAllocator*>(this);
+  }
+
+  // Strong guarantees
+  template<typename ... Args>
+  ForwardListNodeBase* CreateNode(Args&&... args) {
+    ForwardListNode<value_type>* const node =
+        NodesTraits::allocate(GetAllocator(), 1);
+    try {
+      NodesTraits::construct(GetAllocator(), node,
+          std::forward<Args>(args)...);
+    } catch (...) {
+      NodesTraits::deallocate(GetAllocator(), node, 1);
+      throw;
+    }
+    return node;
+  }
+
+  void LinkAfter(ForwardListNodeBase* const position,
+                 ForwardListNodeBase* const node) {
+    node->next = position->next;
+    position->next = node;
+    if (tail_ == position) {
+      tail_ = node;
+    }
+    ++size_;
+  }
+
+  // Moves count nodes of x, from the one after before_first to last, after
+  // position. x may be this list.
+  void Transfer(const_iterator position,
+                TForwardList& x,
+                ForwardListNodeBase* const before_first,
+                ForwardListNodeBase* const last,
+                const size_type count) {
+    ForwardListNodeBase* const position_ptr =
+        const_cast<ForwardListNodeBase*>(position.ptr);
+    ForwardListNodeBase* const first = before_first->next;
+    before_first->next = last->next;
+    if (x.tail_ == last) {
+      x.tail_ = before_first;
+    }
+    x.size_ -= count;
+    last->next = position_ptr->next;
+    position_ptr->next = first;
+    if (tail_ == position_ptr) {
+      tail_ = last;
+    }
+    size_ += count;
+  }
+
+  ForwardListNodeBase* FindTail() {
+    ForwardListNodeBase* node = &base_;
+    while (node->next) {
+      node = node->next;
+    }
+    return node;
+  }
+
+  void SwapNodes(TForwardList& x) {
+    std::swap(base_.next, x.base_.next);
+    std::swap(tail_, x.tail_);
+    std::swap(size_, x.size_);
+    if (tail_ == &x.base_) {
+      tail_ = &base_;
+    }
+    if (x.tail_ == &base_) {
+      x.tail_ = &x.base_;
+    }
+  }
+
+  void SwapAllocators(TForwardList& x, std::true_type) {
+    using std::swap;
+    swap(GetAllocator(), x.GetAllocator());
+  }
+
+  void SwapAllocators(TForwardList&, std::false_type) {
+  }
+
+  void CopyAllocator(const NodesAllocator& allocator, std::true_type) {
+    GetAllocator() = allocator;
+  }
+
+  void CopyAllocator(const NodesAllocator&, std::false_type) {
+  }
+
+  void MoveAllocator(NodesAllocator& allocator, std::true_type) {
+    GetAllocator() = std::move(allocator);
+  }
+
+  void MoveAllocator(NodesAllocator&, std::false_type) {
+  }
+
+  // Destroys and deallocates count nodes linked through next from first to
+  // last, as TList::ReleaseNodes: nodes of trivially destructible elements go
+  // back to an allocator with deallocate_chain in one call.
+  void ReleaseNodes(ForwardListNodeBase* const first,
+                    ForwardListNodeBase* const last,
+                    const size_type count) {
+    ReleaseNodes(first, last, count, std::integral_constant<bool,
+        HasChainDeallocation<NodesAllocator>::value
+            && std::is_trivially_destructible<value_type>::value>());
+  }
+
+  void ReleaseNodes(ForwardListNodeBase* const first,
+                    ForwardListNodeBase* const last,
+                    const size_type count,
+                    std::true_type) {
+    if (count != 0) {
+      this->deallocate_chain(static_cast<ForwardListNode<value_type>*>(first),
+          static_cast<ForwardListNode<value_type>*>(last), count);
+    }
+  }
+
+  void ReleaseNodes(ForwardListNodeBase* first,
+                    ForwardListNodeBase*,
+                    size_type count,
+                    std::false_type) {
+    for (; count != 0; --count) {
+      ForwardListNodeBase* const next = first->next;
+      auto node = static_cast<ForwardListNode<value_type>*>(first);
+      NodesTraits::destroy(GetAllocator(), node);
+      NodesTraits::deallocate(GetAllocator(), node, 1);
+      first = next;
+    }
+  }
+
+  ForwardListNodeBase base_;
+  // The last node, &base_ if the list is empty.
+  ForwardListNodeBase* tail_ = &base_;
+  size_t size_ = 0;
+};
+
+#endif /* FORWARD_LIST_H_ */
@@ -0,0 +1,476 @@
+/*
+ * intrusive_list.h
+ *
+ * TIntrusiveList: a list of objects which live elsewhere, in pools, arrays or
+ * on the stack, and link into the list through a ListNodeBase member of their
+ * own. Inserting and erasing never allocate, and an iterator to an object is
+ * got from the object itself. Splicing, sorting and merging relink the hooks
+ * with the algorithms of TList (ListChains of lst.h).
+ */
+
+#ifndef INTRUSIVE_LIST_H_
+#define INTRUSIVE_LIST_H_
+
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+#include "lst.h"
+
+// Conversions between an object and its hook. A member pointer gives no
+// offset without an object, so NodeOf records it from the real objects: every
+// hook enters a list through NodeOf before ObjectOf can see it, and the list
+// orders the two as it orders any other access to the hook.
+template<typename T, ListNodeBase T::*Hook>
+struct IntrusiveListHook {
+  static ListNodeBase* NodeOf(T& object) {
+    ListNodeBase* const node = &(object.*Hook);
+    Offset().store(reinterpret_cast<char*>(node)
+        - reinterpret_cast<char*>(&object), std::memory_order_relaxed);
+    return node;
+  }
+
+  static T* ObjectOf(ListNodeBase* const node) {
+    return reinterpret_cast<T*>(reinterpret_cast<char*>(node)
+        - Offset().load(std::memory_order_relaxed));
+  }
+
+  // Offset of the hook in T, the same for all objects.
+  static std::atomic<ptrdiff_t>& Offset() {
+    static std::atomic<ptrdiff_t> offset(0);
+    return offset;
+  }
+};
+
+template<typename T, ListNodeBase T::*Hook>
+struct IntrusiveListIterator {
+  typedef std::bidirectional_iterator_tag iterator_category;
+  typedef T value_type;
+  typedef T* pointer;
+  typedef T& reference;
+  typedef ptrdiff_t difference_type;
+
+  IntrusiveListIterator(ListNodeBase* const ptr)
+      : ptr(ptr) {
+  }
+
+  reference operator*() const {
+    return *IntrusiveListHook<T, Hook>::ObjectOf(ptr);
+  }
+
+  pointer operator->() const {
+    return IntrusiveListHook<T, Hook>::ObjectOf(ptr);
+  }
+
+  IntrusiveListIterator& operator++() {
+    ptr = ptr->next;
+    return *this;
+  }
+
+  IntrusiveListIterator operator++(int) {
+    IntrusiveListIterator tmp = *this;
+    ptr = ptr->next;
+    return tmp;
+  }
+
+  IntrusiveListIterator& operator--() {
+    ptr = ptr->prev;
+    return *this;
+  }
+
+  IntrusiveListIterator operator--(int) {
+    IntrusiveListIterator tmp = *this;
+    ptr = ptr->prev;
+    return tmp;
+  }
+
+  bool operator==(const IntrusiveListIterator& other) const {
+    return ptr == other.ptr;
+  }
+
+  bool operator!=(const IntrusiveListIterator& other) const {
+    return ptr != other.ptr;
+  }
+
+  ListNodeBase* ptr;
+};
+
+template<typename T, ListNodeBase T::*Hook>
+struct IntrusiveListConstIterator {
+  typedef IntrusiveListIterator<T, Hook> iterator;
+
+  typedef std::bidirectional_iterator_tag iterator_category;
+  typedef T value_type;
+  typedef const T* pointer;
+  typedef const T& reference;
+  typedef ptrdiff_t difference_type;
+
+  IntrusiveListConstIterator(const ListNodeBase* const ptr)
+      : ptr(ptr) {
+  }
+
+  IntrusiveListConstIterator(const iterator& other)
+      : ptr(other.ptr) {
+  }
+
+  reference operator*() const {
+    return *IntrusiveListHook<T, Hook>::ObjectOf(
+        const_cast<ListNodeBase*>(ptr));
+  }
+
+  pointer operator->() const {
+    return IntrusiveListHook<T, Hook>::ObjectOf(
+        const_cast<ListNodeBase*>(ptr));
+  }
+
+  IntrusiveListConstIterator& operator++() {
+    ptr = ptr->next;
+    return *this;
+  }
+
+  IntrusiveListConstIterator operator++(int) {
+    IntrusiveListConstIterator tmp = *this;
+    ptr = ptr->next;
+    return tmp;
+  }
+
+  IntrusiveListConstIterator& operator--() {
+    ptr = ptr->prev;
+    return *this;
+  }
+
+  IntrusiveListConstIterator operator--(int) {
+    IntrusiveListConstIterator tmp = *this;
+    ptr = ptr->prev;
+    return tmp;
+  }
+
+  bool operator==(const IntrusiveListConstIterator& other) const {
+    return ptr == other.ptr;
+  }
+
+  bool operator!=(const IntrusiveListConstIterator& other) const {
+    return ptr != other.ptr;
+  }
+
+  const ListNodeBase* ptr;
+};
+
+// List of objects of T linked through their member Hook, e.g.
+//   struct Task { ListNodeBase hook; int priority; };
+//   TIntrusiveList<Task, &Task::hook> queue;
+// The list does not own the objects: they must outlive their stay in it,
+// and an object is in one list per hook at a time. Erased objects get their
+// hook reset to a fresh ListNodeBase, so clear() and the destructor walk the
+// list. Iterators, pointers and references stay valid until the object is
+// erased, also across splice, sort and merge.
+template<typename T, ListNodeBase T::*Hook>
+class TIntrusiveList {
+public:
+  typedef T value_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef IntrusiveListIterator<T, Hook> iterator;
+  typedef IntrusiveListConstIterator<T, Hook> const_iterator;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+
+  TIntrusiveList() {
+  }
+
+  TIntrusiveList(const TIntrusiveList& x) = delete;
+
+  TIntrusiveList(TIntrusiveList&& x) noexcept {
+    swap(x);
+  }
+
+  ~TIntrusiveList() {
+    clear();
+  }
+
+  TIntrusiveList& operator=(const TIntrusiveList& x) = delete;
+
+  TIntrusiveList& operator=(TIntrusiveList&& x) noexcept {
+    if (this != &x) {
+      clear();
+      swap(x);
+    }
+    return *this;
+  }
+
+  void push_back(T& value) noexcept {
+    insert(end(), value);
+  }
+
+  void push_front(T& value) noexcept {
+    insert(begin(), value);
+  }
+
+  void pop_back() noexcept {
+    erase(const_iterator(base_.prev));
+  }
+
+  void pop_front() noexcept {
+    erase(begin());
+  }
+
+  iterator insert(const_iterator position, T& value) noexcept {
+    ListNodeBase* const node = Hooks::NodeOf(value);
+    ListChains::Link(const_cast<ListNodeBase*>(position.ptr), node, node);
+    ++size_;
+    return iterator(node);
+  }
+
+  // Links the objects of [first, last) before position, in order.
+  template<class InputIterator>
+  iterator insert(const_iterator position,
+                  InputIterator first,
+                  InputIterator last) noexcept {
+    iterator result(const_cast<ListNodeBase*>(position.ptr));
+    if (first != last) {
+      result = insert(position, *first);
+      for (++first; first != last; ++first) {
+        insert(position, *first);
+      }
+    }
+    return result;
+  }
+
+  iterator erase(const_iterator position) noexcept {
+    ListNodeBase* const node = const_cast<ListNodeBase*>(position.ptr);
+    ListNodeBase* const next = node->next;
+    next->prev = node->prev;
+    node->prev->next = next;
+    node->next = node;
+    node->prev = node;
+    --size_;
+    return iterator(next);
+  }
+
+  iterator erase(const_iterator first, const_iterator last) noexcept {
+    while (first != last) {
+      first = erase(first);
+    }
+    return iterator(const_cast<ListNodeBase*>(last.ptr));
+  }
+
+  void clear() noexcept {
+    erase(begin(), end());
+  }
+
+  // Iterator to value, which must be in the list. O(1).
+  iterator iterator_to(T& value) noexcept {
+    return iterator(Hooks::NodeOf(value));
+  }
+
+  const_iterator iterator_to(const T& value) const noexcept {
+    return const_iterator(Hooks::NodeOf(const_cast<T&>(value)));
+  }
+
+  void splice(const_iterator position,
+              TIntrusiveList&& x,
+              const_iterator first,
+              const_iterator last) noexcept {
+    if (first == last) {
+      return;
+    }
+    const size_t size_delta = std::distance(first, last);
+    ListChains::Transfer(const_cast<ListNodeBase*>(position.ptr),
+        const_cast<ListNodeBase*>(first.ptr),
+        const_cast<ListNodeBase*>(last.ptr->prev));
+    x.size_ -= size_delta;
+    size_ += size_delta;
+  }
+
+  void splice(const_iterator position,
+              TIntrusiveList& x,
+              const_iterator first,
+              const_iterator last) noexcept {
+    splice(position, std::move(x), first, last);
+  }
+
+  // Moves the object of i.
+  void splice(const_iterator position,
+              TIntrusiveList&& x,
+              const_iterator i) noexcept {
+    ListNodeBase* const node = const_cast<ListNodeBase*>(i.ptr);
+    if (node != position.ptr && node->next != position.ptr) {
+      ListChains::Transfer(const_cast<ListNodeBase*>(position.ptr), node,
+          node);
+      --x.size_;
+      ++size_;
+    }
+  }
+
+  void splice(const_iterator position,
+              TIntrusiveList& x,
+              const_iterator i) noexcept {
+    splice(position, std::move(x), i);
+  }
+
+  void splice(const_iterator position, TIntrusiveList&& x) noexcept {
+    if (!x.empty()) {
+      ListChains::Transfer(const_cast<ListNodeBase*>(position.ptr),
+          x.base_.next, x.base_.prev);
+      size_ += x.size_;
+      x.size_ = 0;
+    }
+  }
+
+  void splice(const_iterator position, TIntrusiveList& x) noexcept {
+    splice(position, std::move(x));
+  }
+
+  iterator begin() {
+    return iterator(base_.next);
+  }
+
+  const_iterator begin() const {
+    return const_iterator(base_.next);
+  }
+
+  const_iterator cbegin() const {
+    return const_iterator(base_.next);
+  }
+
+  iterator end() {
+    return iterator(&base_);
+  }
+
+  const_iterator end() const {
+    return const_iterator(&base_);
+  }
+
+  const_iterator cend() const {
+    return const_iterator(&base_);
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  reference front() {
+    return *begin();
+  }
+
+  const_reference front() const {
+    return *begin();
+  }
+
+  reference back() {
+    return *iterator(base_.prev);
+  }
+
+  const_reference back() const {
+    return *const_iterator(base_.prev);
+  }
+
+  void swap(TIntrusiveList& x) noexcept {
+    base_.swap(x.base_);
+    std::swap(size_, x.size_);
+  }
+
+  void reverse() noexcept {
+    ListNodeBase* node = &base_;
+    do {
+      std::swap(node->prev, node->next);
+      node = node->prev;
+    } while (node != &base_);
+  }
+
+  void merge(TIntrusiveList&& x) {
+    merge(std::move(x), ElementsLess());
+  }
+
+  void merge(TIntrusiveList& x) {
+    merge(std::move(x), ElementsLess());
+  }
+
+  // Moves the objects of x into the list, both sorted by comp, as
+  // TList::merge. Objects of the list go first among equal ones.
+  // If a comparison throws, both lists stay sorted, and the objects of x
+  // which were already moved stay in this one.
+  template<typename Compare>
+  void merge(TIntrusiveList&& x, Compare comp) {
+    if (this == &x || x.empty()) {
+      return;
+    }
+    size_type moved = 0;
+    try {
+      ListChains::MergeLists(base_, x.base_, x.size_, moved,
+          NodesLess<Compare>(comp));
+    } catch (...) {
+      x.size_ -= moved;
+      size_ += moved;
+      throw;
+    }
+    x.size_ -= moved;
+    size_ += moved;
+  }
+
+  template<typename Compare>
+  void merge(TIntrusiveList& x, Compare comp) {
+    merge(std::move(x), comp);
+  }
+
+  // Stable merge sort of the hooks, as TList::sort.
+  // If a comparison throws, all objects stay in the list in some order.
+  void sort() {
+    sort(ElementsLess());
+  }
+
+  template<typename Compare>
+  void sort(Compare comp) {
+    if (size_ >= 2) {
+      ListChains::SortList(base_, NodesLess<Compare>(comp));
+    }
+  }
+
+  template<typename Predicate>
+  void remove_if(Predicate pred) {
+    for (const_iterator iter = begin(); iter != end();) {
+      if (pred(*iter)) {
+        iter = erase(iter);
+      } else {
+        ++iter;
+      }
+    }
+  }
+
+private:
+  typedef IntrusiveListHook<T, Hook> Hooks;
+
+  // operator< of the objects, what sort() and merge() use by default.
+  struct ElementsLess {
+    bool operator()(const T& x, const T& y) const {
+      return x < y;
+    }
+  };
+
+  // Compares hooks by their objects.
+  template<typename Compare>
+  struct NodesLess {
+    explicit NodesLess(Compare& comp)
+        : comp(comp) {
+    }
+
+    bool operator()(ListNodeBase* const x, ListNodeBase* const y) const {
+      return comp(*Hooks::ObjectOf(x), *Hooks::ObjectOf(y));
+    }
+
+    Compare& comp;
+  };
+
+  ListNodeBase base_;
+  size_t size_ = 0;
+};
+
+#endif /* INTRUSIVE_LIST_H_ */
@@ -0,0 +1,176 @@
+/*
+ * list_algorithms.h
+ *
+ * Parallel algorithms over the elements of a TList (or std::list). A list
+ * cannot be cut by index, so TListChunks walks it once and keeps iterators to
+ * the bounds of balanced chunks; the chunks then run on a pool such as
+ * TThreadPool of thread_pool.h.
+ */
+
+#ifndef LIST_ALGORITHMS_H_
+#define LIST_ALGORITHMS_H_
+
+#include <cstddef>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Result, if List is a list rather than TListChunks, which has no begin().
+template<typename List, typename Result, typename = void>
+struct EnableIfList {
+};
+
+template<typename List, typename Result>
+struct EnableIfList<List, Result, decltype(void(
+    std::declval<List&>().begin()))> {
+  typedef Result type;
+};
+
+// Iterators to the first element of every chunk of a list, and to its end.
+// Chunks differ in length by one element at most. Stay valid while no
+// element is inserted into or erased from the list, so one cut serves many
+// algorithm calls; the elements themselves may change.
+template<typename List>
+class TListChunks {
+public:
+  typedef decltype(std::declval<List&>().begin()) Iterator;
+
+  // Chunks of at least kMinChunkLength elements, several per thread of pool,
+  // so that threads which are done early steal the rest of the work.
+  template<typename Pool, typename = decltype(
+      std::declval<const Pool&>().ThreadsCount())>
+  TListChunks(List& list, const Pool& pool) {
+    Cut(list, std::min((pool.ThreadsCount() + 1) * kChunksPerThread,
+        list.size() / kMinChunkLength));
+  }
+
+  TListChunks(List& list, const size_t chunks_count) {
+    Cut(list, chunks_count);
+  }
+
+  size_t Count() const {
+    return bounds.size() - 1;
+  }
+
+  Iterator Begin(const size_t chunk) const {
+    return bounds[chunk];
+  }
+
+  Iterator End(const size_t chunk) const {
+    return bounds[chunk + 1];
+  }
+
+  static const size_t kChunksPerThread = 4;
+  static const size_t kMinChunkLength = 4096;
+
+private:
+  // One chunk for short lists, none for empty ones.
+  void Cut(List& list, size_t chunks_count) {
+    const size_t length = list.size();
+    chunks_count = std::max<size_t>(std::min(chunks_count, length),
+        length == 0 ? 0 : 1);
+    bounds.reserve(chunks_count + 1);
+    Iterator iter = list.begin();
+    for (size_t i = 0; i != chunks_count; ++i) {
+      bounds.push_back(iter);
+      // Earlier chunks take the remainder, one element each.
+      const size_t chunk_length = length / chunks_count
+          + (i < length % chunks_count ? 1 : 0);
+      for (size_t j = 0; j != chunk_length; ++j) {
+        ++iter;
+      }
+    }
+    bounds.push_back(iter);
+  }
+
+  std::vector<Iterator> bounds;
+};
+
+// Calls function(element) for every element, from several threads at once.
+template<typename Pool, typename List, typename Function>
+void parallel_for_each(Pool& pool,
+                       const TListChunks<List>& chunks,
+                       Function function) {
+  pool.Run(chunks.Count(), [&chunks, &function](const size_t chunk) {
+    const auto end = chunks.End(chunk);
+    for (auto iter = chunks.Begin(chunk); iter != end; ++iter) {
+      function(*iter);
+    }
+  });
+}
+
+template<typename Pool, typename List, typename Function>
+typename EnableIfList<List, void>::type parallel_for_each(
+    Pool& pool,
+    List& list,
+    Function function) {
+  parallel_for_each(pool, TListChunks<List>(list, pool), function);
+}
+
+// reduce(init, transform(element)...) over all elements, as
+// std::transform_reduce: reduce must be associative and commutative, as the
+// elements of every chunk are reduced on their own and then the results of
+// the chunks in turn.
+template<typename Pool, typename List, typename T, typename Reduce,
+    typename Transform>
+T parallel_transform_reduce(Pool& pool,
+                            const TListChunks<List>& chunks,
+                            T init,
+                            Reduce reduce,
+                            Transform transform) {
+  // Every chunk has an element, so its result starts from the first one.
+  std::vector<T> results(chunks.Count(), init);
+  pool.Run(chunks.Count(),
+      [&chunks, &reduce, &transform, &results](const size_t chunk) {
+        auto iter = chunks.Begin(chunk);
+        const auto end = chunks.End(chunk);
+        T result = transform(*iter);
+        for (++iter; iter != end; ++iter) {
+          result = reduce(std::move(result), transform(*iter));
+        }
+        results[chunk] = std::move(result);
+      });
+  for (auto& result : results) {
+    init = reduce(std::move(init), std::move(result));
+  }
+  return init;
+}
+
+template<typename Pool, typename List, typename T, typename Reduce,
+    typename Transform>
+typename EnableIfList<const List, T>::type parallel_transform_reduce(
+    Pool& pool,
+    const List& list,
+    T init,
+    Reduce reduce,
+    Transform transform) {
+  return parallel_transform_reduce(pool,
+      TListChunks<const List>(list, pool), std::move(init), reduce,
+      transform);
+}
+
+// Number of elements for which predicate is true.
+template<typename Pool, typename List, typename Predicate>
+size_t parallel_count_if(Pool& pool,
+                         const TListChunks<List>& chunks,
+                         Predicate predicate) {
+  return parallel_transform_reduce(pool, chunks, size_t(0),
+      [](const size_t x, const size_t y) {
+        return x + y;
+      },
+      [&predicate](const typename List::value_type& element) {
+        return predicate(element) ? size_t(1) : size_t(0);
+      });
+}
+
+template<typename Pool, typename List, typename Predicate>
+typename EnableIfList<const List, size_t>::type parallel_count_if(
+    Pool& pool,
+    const List& list,
+    Predicate predicate) {
+  return parallel_count_if(pool, TListChunks<const List>(list, pool),
+      predicate);
+}
+
+#endif /* LIST_ALGORITHMS_H_ */
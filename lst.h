@@ -1,730 +1,1514 @@
-/*
- * lst.h
- *
- *  Created on: 31  2016 .
- *      Author: user
- */
-
-#ifndef LST_H_
-#define LST_H_
-
-#include <cstddef>
-#include <algorithm>
-#include <iterator>
-
-struct ListNodeBase {
-  ListNodeBase* next;
-  ListNodeBase* prev;
-
-  ListNodeBase()
-      : next(this), prev(this) {
-  }
-
-  void swap(ListNodeBase& other) {
-    std::swap(*this, other);
-    if (next == &other) {
-      next = this;
-      prev = this;
-    } else {
-      next->prev = this;
-      prev->next = this;
-    }
-    if (other.next == this) {
-      other.next = &other;
-      other.prev = &other;
-    } else {
-      other.next->prev = &other;
-      other.prev->next = &other;
-    }
-  }
-};
-
-template<typename T>
-struct ListNode : public ListNodeBase {
-  T data;
-
-  template<typename ... Args>
-  ListNode(Args&&... args)
-      : data(std::forward<Args>(args)...) {
-  }
-};
-
-template<typename T>
-struct ListIterator {
-  typedef ListNode<T> Node;
-
-  typedef ptrdiff_t difference_type;
-  typedef std::bidirectional_iterator_tag iterator_category;
-  typedef T value_type;
-  typedef T* pointer;
-  typedef T& reference;
-
-  ListNodeBase* ptr;
-
-  ListIterator(ListNodeBase* const ptr)
-      : ptr(ptr) {
-  }
-
-  reference operator*() const {
-    return static_cast<Node*>(ptr)->data;
-  }
-
-  pointer operator->() const {
-    return std::__addressof(static_cast<Node*>(ptr)->data);
-  }
-
-  ListIterator& operator++() {
-    ptr = ptr->next;
-    return *this;
-  }
-
-  ListIterator operator++(int) {
-    auto tmp = *this;
-    ptr = ptr->next;
-    return tmp;
-  }
-
-  ListIterator& operator--() {
-    ptr = ptr->prev;
-    return *this;
-  }
-
-  ListIterator operator--(int) {
-    auto tmp = *this;
-    ptr = ptr->prev;
-    return tmp;
-  }
-
-  bool operator==(const ListIterator& other) const {
-    return ptr == other.ptr;
-  }
-
-  bool operator!=(const ListIterator& other) const {
-    return ptr != other.ptr;
-  }
-};
-
-template<typename T>
-struct ListConstIterator {
-  typedef const ListNode<T> Node;
-  typedef ListIterator<T> iterator;
-
-  typedef ptrdiff_t difference_type;
-  typedef std::bidirectional_iterator_tag iterator_category;
-  typedef T value_type;
-  typedef const T* pointer;
-  typedef const T& reference;
-
-  const ListNodeBase* ptr;
-
-  ListConstIterator(const ListNodeBase* const ptr)
-      : ptr(ptr) {
-  }
-
-  ListConstIterator(const iterator& other)
-      : ptr(other.ptr) {
-  }
-
-  reference operator*() const {
-    return static_cast<Node*>(ptr)->data;
-  }
-
-  pointer operator->() const {
-    return std::__addressof(static_cast<Node*>(ptr)->data);
-  }
-
-  ListConstIterator& operator++() {
-    ptr = ptr->next;
-    return *this;
-  }
-
-  ListConstIterator operator++(int) {
-    auto tmp = *this;
-    ptr = ptr->next;
-    return tmp;
-  }
-  ListConstIterator& operator--() {
-    ptr = ptr->prev;
-    return *this;
-  }
-
-  ListConstIterator operator--(int) {
-    auto tmp = *this;
-    ptr = ptr->prev;
-    return tmp;
-  }
-
-  bool operator==(const ListConstIterator& other) const {
-    return ptr == other.ptr;
-  }
-
-  bool operator!=(const ListConstIterator& other) const {
-    return ptr != other.ptr;
-  }
-};
-
-template<typename T, typename Allocator = std::allocator<T>>
-class TList : private Allocator::template rebind<ListNode<T>>::other {
-public:
-  typedef T value_type;
-  typedef T* pointer;
-  typedef const T* const_pointer;
-  typedef T& reference;
-  typedef const T& const_reference;
-  typedef ListIterator<T> iterator;
-  typedef ListConstIterator<T> const_iterator;
-  typedef size_t size_type;
-  typedef ptrdiff_t difference_type;
-  typedef Allocator allocator_type;
-
-private:
-  typedef typename Allocator::template rebind<ListNode<value_type>>::other NodesAllocator;
-
-public:
-  // Strong guarantees (no changes in case of exception, i. e. all would be destroyed)
-  TList(const allocator_type& alloc = allocator_type())
-      : NodesAllocator(alloc) {
-  }
-
-  // Strong guarantees (no changes in case of exception, i. e. all would be destroyed)
-  TList(const TList& x)
-      : NodesAllocator(x.GetAllocator()) {
-    try {
-      for (auto iter = x.begin(); iter != x.end(); ++iter) {
-        emplace_back(*iter);
-      }
-    } catch (...) {
-      DestroyAll();
-    }
-  }
-
-  TList(TList&& x)
-      : NodesAllocator(std::move(x.GetAllocator())) {
-    swap(x);
-  }
-
-  // Strong guarantees (no changes in case of exception, i. e. all would be destroyed)
-  explicit TList(size_type n) {
-    try {
-      for (; size_ != n; ++size_) {
-        emplace_back();
-      }
-    } catch (...) {
-      DestroyAll();
-    }
-  }
-
-  // Strong guarantees (no changes in case of exception, i. e. all would be destroyed)
-  TList(size_type n, const value_type& val, const allocator_type& alloc =
-            allocator_type())
-      : NodesAllocator(alloc) {
-    try {
-      while (size_ != n) {
-        emplace_back(val);
-      }
-    } catch (...) {
-      DestroyAll();
-    }
-  }
-
-  // Strong guarantees (no changes in case of exception, i. e. all would be destroyed)
-  template<class InputIterator, typename = std::_RequireInputIter<
-      InputIterator>>
-  TList(InputIterator first,
-        InputIterator last,
-        const allocator_type& alloc = allocator_type())
-      : NodesAllocator(alloc) {
-    try {
-      for (auto iter = first; iter != last; ++iter) {
-        emplace_back(*iter);
-      }
-    } catch (...) {
-      DestroyAll();
-    }
-  }
-
-  ~TList() {
-    DestroyAll();
-  }
-
-  // Basic guarantees (no memory leak)
-  TList& operator=(const TList& x) {
-    if (this != &x) {
-      iterator my_first = begin();
-      iterator my_last = end();
-      const_iterator x_first = x.begin();
-      const_iterator x_last = x.end();
-      for (; my_first != my_last && x_first != x_last;
-          ++my_first, ++x_first) {
-        *my_first = *x_first;
-      }
-      if (x_first == x_last) {
-        erase(my_first, my_last);
-      } else {
-        insert(my_last, x_first, x_last);
-      }
-    }
-
-    return *this;
-  }
-
-  TList& operator=(TList&& x) {
-    clear();
-    swap(x);
-    return *this;
-  }
-
-  // Strong guarantees (no changes in case of exception)
-  template<typename ... Args>
-  void emplace_back(Args&&... args) {
-    auto ptr = CreateNode(std::forward<Args>(args)...);
-    PtrsWork(ptr, ptr, &base_);
-  }
-
-  // Strong guarantees (no changes in case of exception)
-  template<typename ... Args>
-  void emplace_front(Args&&... args) {
-    auto ptr = CreateNode(std::forward<Args>(args)...);
-    PtrsWork(ptr, ptr, base_.next);
-  }
-
-  // Strong guarantees (no changes in case of exception)
-  void push_back(const value_type& val) {
-    insert(end(), val);
-  }
-  // Strong guarantees (no changes in case of exception)
-  void push_back(value_type&& val) {
-    emplace_back(std::move(val));
-  }
-
-  // Strong guarantees (no changes in case of exception)
-  void push_front(const value_type& val) {
-    insert(begin(), val);
-  }
-
-  // Strong guarantees (no changes in case of exception)
-  void push_front(value_type&& val) {
-    emplace_front(std::move(val));
-  }
-
-  void pop_back() noexcept {
-    erase(--end());
-  }
-
-  void pop_front() noexcept {
-    erase(begin());
-  }
-
-  iterator erase(const_iterator position) noexcept {
-    return erase(position, std::next(position));
-  }
-
-  iterator erase(const_iterator first, const_iterator last) noexcept {
-    ListNodeBase* ptr = const_cast<ListNodeBase*>(first.ptr);
-    auto last_ptr = const_cast<ListNodeBase*>(last.ptr);
-    auto my_left = ptr->prev;
-    while (ptr != last_ptr) {
-      auto tmp = ptr->next;
-      this->destroy(static_cast<ListNode<value_type>*>(ptr));
-      this->deallocate(static_cast<ListNode<value_type>*>(ptr), 1);
-      --size_;
-      ptr = tmp;
-    }
-    auto my_right = last_ptr;
-    my_right->prev = my_left;
-    if (!my_left) {
-      base_.next = my_right;
-    } else {
-      my_left->next = my_right;
-    }
-
-    return iterator(my_right);
-  }
-
-  // Strong guarantees (no changes in case of exception)
-  void splice(const_iterator position,
-              TList&& x,
-              const_iterator first,
-              const_iterator last) noexcept {
-    const size_t size_delta = std::distance(first, last);
-
-    Splice(position, std::move(x), first, last);
-
-    x.size_ -= size_delta;
-    size_ += size_delta;
-  }
-
-  // Strong guarantees (no changes in case of exception)
-  void splice(const_iterator position,
-              TList& x,
-              const_iterator first,
-              const_iterator last) noexcept {
-    splice(position, std::move(x), first, last);
-  }
-
-  // Strong guarantees (no changes in case of exception)
-  void splice(const_iterator position, TList&& x) noexcept {
-    if (!x.empty()) {
-      Splice(position, std::move(x), x.begin(), x.end());
-      size_ += x.size_;
-      x.size_ = 0;
-    }
-  }
-
-  // Strong guarantees (no changes in case of exception)
-  void splice(const_iterator position, TList& x) noexcept {
-    splice(position, std::move(x));
-  }
-
-  // Strong guarantees (no changes in case of exception)
-  iterator insert(const_iterator position, const value_type& val) {
-    auto new_ptr = CreateNode(val);
-    auto right_ptr = const_cast<ListNodeBase*>(position.ptr);
-    PtrsWork(new_ptr, new_ptr, right_ptr);
-    return iterator(new_ptr);
-  }
-
-  // Strong guarantees (no changes in case of exception)
-  iterator insert(const_iterator position,
-                  size_type n,
-                  const value_type& val) {
-    TList tmp(n, val);
-    iterator iter = tmp.begin();
-    splice(position, tmp);
-    return iter;
-  }
-
-  // Strong guarantees (no changes in case of exception)
-  template<class InputIterator>
-  iterator insert(const_iterator position,
-                  InputIterator first,
-                  InputIterator last) {
-    TList tmp(first, last);
-    if (!tmp.empty()) {
-      iterator it = tmp.begin();
-      splice(position, tmp);
-      return it;
-    }
-
-    return iterator(const_cast<ListNodeBase*>(position.ptr));
-  }
-
-  iterator begin() {
-    return iterator(base_.next);
-  }
-
-  const_iterator begin() const {
-    return const_iterator(base_.next);
-  }
-
-  const_iterator cbegin() const {
-    return const_iterator(base_.next);
-  }
-
-  iterator end() {
-    return iterator(&base_);
-  }
-
-  const_iterator end() const {
-    return const_iterator(&base_);
-  }
-
-  const_iterator cend() const {
-    return const_iterator(&base_);
-  }
-
-  bool empty() const {
-    return base_.next == &base_;
-  }
-
-  size_t size() const {
-    return size_;
-  }
-
-  reference front() {
-    return *begin();
-  }
-
-  const_reference front() const {
-    return *begin();
-  }
-
-  reference back() {
-    iterator tmp = end();
-    --tmp;
-    return *tmp;
-  }
-
-  const_reference back() const {
-    const_iterator tmp = end();
-    --tmp;
-    return *tmp;
-  }
-
-  // Basic guarantees (no memory leak)
-  void assign(size_type n, const value_type& val) {
-    iterator i = begin();
-    for (; i != end() && n > 0; ++i, --n) {
-      *i = val;
-    }
-    if (n > 0) {
-      insert(end(), n, val);
-    } else {
-      erase(i, end());
-    }
-  }
-
-  void swap(TList& x) {
-    base_.swap(x.base_);
-    std::swap(size_, x.size_);
-    std::swap(GetAllocator(), x.GetAllocator());
-  }
-
-  // Strong guarantees (no changes in case of exception)
-  void resize(size_type new_size) {
-    while (size_ > new_size) {
-      erase(--end());
-    }
-    if (size_ < new_size) {
-      DefaultAppend(new_size - size_);
-    }
-  }
-
-  // Strong guarantees (no changes in case of exception)
-  void resize(size_type new_size, const value_type& val) {
-    while (size_ > new_size) {
-      erase(--end());
-    }
-    if (size_ < new_size) {
-      insert(end(), new_size - size_, val);
-    }
-  }
-
-  void clear() noexcept {
-    erase(begin(), end());
-  }
-
-  void reverse() noexcept {
-    if (!empty() && base_.prev != base_.next) {
-      auto current_ptr = base_.next;
-      while (current_ptr != &base_) {
-        auto next = current_ptr->next;
-        std::swap(current_ptr->prev, current_ptr->next);
-        current_ptr = next;
-      }
-      base_.next->next = &base_;
-      base_.prev->prev = nullptr;
-      auto new_before_tail = base_.next;
-      base_.next = base_.prev;
-      base_.prev = new_before_tail;
-    }
-  }
-
-  void merge(TList&& x) {
-    if (this != &x) {
-      iterator my_first = begin();
-      iterator my_last = end();
-      iterator x_first = x.begin();
-      iterator x_last = x.end();
-      while (my_first != my_last && x_first != x_last)
-        if (*x_first < *my_first) {
-          iterator next = x_first;
-          splice(my_first, x, x_first, ++next);
-          x_first = next;
-        } else {
-          ++my_first;
-        }
-      if (x_first != x_last) {
-        splice(my_last, std::move(x), x_first, x_last);
-      }
-    }
-  }
-
-  void merge(TList& x) {
-    merge(std::move(x));
-  }
-
-  void sort() {
-    // Let's do nothing if the list has length 0 or 1.
-    if (!empty() && base_.prev != base_.next) {
-      {
-        TList carry;
-        TList tmp[64];
-        TList* fill = &tmp[0];
-        TList* counter;
-
-        do {
-          carry.splice(carry.begin(), *this, begin(), ++begin());
-          for (counter = &tmp[0]; counter != fill && !counter->empty();
-              ++counter) {
-            counter->merge(carry);
-            carry.swap(*counter);
-          }
-          carry.swap(*counter);
-          if (counter == fill) {
-            ++fill;
-          }
-        } while (!empty());
-
-        for (counter = &tmp[1]; counter != fill; ++counter)
-          counter->merge(*(counter - 1));
-        swap(*(fill - 1));
-      }
-    }
-  }
-
-  void unique() {
-    iterator first = begin();
-    iterator last = end();
-    if (first == last) {
-      return;
-    }
-    iterator next = first;
-    while (++next != last) {
-      if (*first == *next) {
-        erase(next);
-      } else {
-        first = next;
-      }
-      next = first;
-    }
-  }
-
-private:
-  void DestroyAll() {
-    erase(begin(), end());
-  }
-
-  NodesAllocator& GetAllocator() {
-    return *static_cast<NodesAllocator*>(this);
-  }
-
-  const NodesAllocator& GetAllocator() const {
-    return *static_cast<const NodesAllocator*>(this);
-  }
-
-  // Strong guarantees (no changes in case of exception)
-  void DefaultAppend(size_type n) {
-    size_type i = 0;
-    try {
-      for (; i < n; ++i) {
-        emplace_back();
-      }
-    } catch (...) {
-      for (; i; --i) {
-        pop_back();
-      }
-      throw;
-    }
-  }
-
-  // Strong guarantees
-  template<typename ... Args>
-  ListNode<value_type>* CreateNode(Args&&... args) {
-    ListNode<value_type>* ptr(this->allocate(1));
-    try {
-      this->construct(ptr, std::forward<Args>(args)...);
-    } catch (...) {
-      this->deallocate(ptr, 1);
-      throw;
-    }
-
-    ++size_;
-    return ptr;
-  }
-
-  // Some rountine work with ptrs. new_left and new_right are first and last
-  // nodes of inserted diapason. new_left and new_right might be equal.
-  // my_right_ptr - is old node which already existed. new nodes are inserted right before it.
-  void PtrsWork(ListNodeBase* new_left,
-                ListNodeBase* new_right,
-                ListNodeBase* my_right_ptr) {
-    auto my_left = my_right_ptr->prev;
-    my_right_ptr->prev = new_right;
-    new_right->next = my_right_ptr;
-    new_left->prev = my_left;
-    if (!my_left) {
-      base_.next = new_left;
-    } else {
-      my_left->next = new_left;
-    }
-  }
-
-  void Splice(const_iterator position,
-              TList&& x,
-              const_iterator first,
-              const_iterator last) noexcept {
-    auto x_first_to_transfer = const_cast<ListNodeBase*>(first.ptr);
-    auto x_last_to_transfer = const_cast<ListNodeBase*>((--last).ptr);
-    auto x_first_after_transferred_ptrs = x_last_to_transfer->next;
-    auto x_last_before_transferred_ptrs = x_first_to_transfer->prev;
-    auto my_first_after_new_transeferred_ptrs =
-        const_cast<ListNodeBase*>(position.ptr);
-    PtrsWork(x_first_to_transfer, x_last_to_transfer,
-        my_first_after_new_transeferred_ptrs);
-
-    x_first_after_transferred_ptrs->prev = x_last_before_transferred_ptrs;
-    if (!x_last_before_transferred_ptrs) {
-      x.base_.next = x_first_after_transferred_ptrs;
-    } else {
-      x_last_before_transferred_ptrs->next =
-          x_first_after_transferred_ptrs;
-    }
-  }
-
-  ListNodeBase base_;
-  size_t size_ = 0;
-};
-
-
-
-template<typename T>
-inline bool operator==(const ListIterator<T>& x,
-                       const ListConstIterator<T>& y) noexcept
-                       {
-  return x.ptr == y.ptr;
-}
-
-template<typename T>
-inline bool operator!=(const ListIterator<T>& x,
-                       const ListConstIterator<T>& y) noexcept
-                       {
-  return x.ptr != y.ptr;
-}
-
-template<typename T, typename Alloc>
-inline bool operator==(const TList<T, Alloc>& x,
-                       const TList<T, Alloc>& y) {
-  typedef typename TList<T, Alloc>::const_iterator const_iterator;
-  const_iterator end1 = x.end();
-  const_iterator end2 = y.end();
-
-  const_iterator i1 = x.begin();
-  const_iterator i2 = y.begin();
-  while (i1 != end1 && i2 != end2 && *i1 == *i2) {
-    ++i1;
-    ++i2;
-  }
-  return i1 == end1 && i2 == end2;
-}
-
-
-
-template<typename T, typename Alloc>
-inline bool operator==(const TList<T, Alloc>& x,
-                       const std::list<T, Alloc>& y) {
-  typedef typename TList<T, Alloc>::const_iterator const_iterator;
-  typedef typename std::list<T, Alloc>::const_iterator std_const_iterator;
-  const_iterator end1 = x.end();
-  std_const_iterator end2 = y.end();
-
-  const_iterator i1 = x.begin();
-  std_const_iterator i2 = y.begin();
-  while (i1 != end1 && i2 != end2 && *i1 == *i2) {
-    ++i1;
-    ++i2;
-  }
-  return i1 == end1 && i2 == end2 && x.size() == y.size();
-}
-
-#endif /* LST_H_ */
+/*
+ * lst.h
+ *
+ *  Created on: 31  2016 .
+ *      Author: user
+ */
+
+#ifndef LST_H_
+#define LST_H_
+
+#include <cstddef>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// next comes first, so nodes linked through next are also linked through their
+// first bytes, as TFastAllocator::deallocate_chain expects.
+struct ListNodeBase {
+  ListNodeBase* next;
+  ListNodeBase* prev;
+
+  ListNodeBase()
+      : next(this), prev(this) {
+  }
+
+  void swap(ListNodeBase& other) {
+    std::swap(*this, other);
+    if (next == &other) {
+      next = this;
+      prev = this;
+    } else {
+      next->prev = this;
+      prev->next = this;
+    }
+    if (other.next == this) {
+      other.next = &other;
+      other.prev = &other;
+    } else {
+      other.next->prev = &other;
+      other.prev->next = &other;
+    }
+  }
+};
+
+template<typename T>
+struct ListNode : public ListNodeBase {
+  T data;
+
+  template<typename ... Args>
+  ListNode(Args&&... args)
+      : data(std::forward<Args>(args)...) {
+  }
+};
+
+template<typename T>
+struct ListIterator {
+  typedef ListNode<T> Node;
+
+  typedef ptrdiff_t difference_type;
+  typedef std::bidirectional_iterator_tag iterator_category;
+  typedef T value_type;
+  typedef T* pointer;
+  typedef T& reference;
+
+  ListNodeBase* ptr;
+
+  ListIterator(ListNodeBase* const ptr)
+      : ptr(ptr) {
+  }
+
+  reference operator*() const {
+    return static_cast<Node*>(ptr)->data;
+  }
+
+  pointer operator->() const {
+    return std::__addressof(static_cast<Node*>(ptr)->data);
+  }
+
+  ListIterator& operator++() {
+    ptr = ptr->next;
+    return *this;
+  }
+
+  ListIterator operator++(int) {
+    auto tmp = *this;
+    ptr = ptr->next;
+    return tmp;
+  }
+
+  ListIterator& operator--() {
+    ptr = ptr->prev;
+    return *this;
+  }
+
+  ListIterator operator--(int) {
+    auto tmp = *this;
+    ptr = ptr->prev;
+    return tmp;
+  }
+
+  bool operator==(const ListIterator& other) const {
+    return ptr == other.ptr;
+  }
+
+  bool operator!=(const ListIterator& other) const {
+    return ptr != other.ptr;
+  }
+};
+
+template<typename T>
+struct ListConstIterator {
+  typedef const ListNode<T> Node;
+  typedef ListIterator<T> iterator;
+
+  typedef ptrdiff_t difference_type;
+  typedef std::bidirectional_iterator_tag iterator_category;
+  typedef T value_type;
+  typedef const T* pointer;
+  typedef const T& reference;
+
+  const ListNodeBase* ptr;
+
+  ListConstIterator(const ListNodeBase* const ptr)
+      : ptr(ptr) {
+  }
+
+  ListConstIterator(const iterator& other)
+      : ptr(other.ptr) {
+  }
+
+  reference operator*() const {
+    return static_cast<Node*>(ptr)->data;
+  }
+
+  pointer operator->() const {
+    return std::__addressof(static_cast<Node*>(ptr)->data);
+  }
+
+  ListConstIterator& operator++() {
+    ptr = ptr->next;
+    return *this;
+  }
+
+  ListConstIterator operator++(int) {
+    auto tmp = *this;
+    ptr = ptr->next;
+    return tmp;
+  }
+  ListConstIterator& operator--() {
+    ptr = ptr->prev;
+    return *this;
+  }
+
+  ListConstIterator operator--(int) {
+    auto tmp = *this;
+    ptr = ptr->prev;
+    return tmp;
+  }
+
+  bool operator==(const ListConstIterator& other) const {
+    return ptr == other.ptr;
+  }
+
+  bool operator!=(const ListConstIterator& other) const {
+    return ptr != other.ptr;
+  }
+};
+
+// Whether Allocator can allocate many single objects in one call, see
+// TFastAllocator::allocate_batch.
+template<typename Allocator, typename = void>
+struct HasBatchAllocation : std::false_type {
+};
+
+template<typename Allocator>
+struct HasBatchAllocation<Allocator, decltype(void(
+    std::declval<Allocator&>().allocate_batch(nullptr, 0)))> : std::true_type {
+};
+
+// Whether Allocator can take back a chain of single objects linked through
+// their first bytes in one call, see TFastAllocator::deallocate_chain.
+template<typename Allocator, typename = void>
+struct HasChainDeallocation : std::false_type {
+};
+
+template<typename Allocator>
+struct HasChainDeallocation<Allocator, decltype(void(
+    std::declval<Allocator&>().deallocate_chain(nullptr, nullptr, 0)))>
+    : std::true_type {
+};
+
+// Whether Allocator::deallocate does nothing, as with TArenaAllocator, so
+// that nodes need not be given back at all. An allocator says so with
+// typedef std::true_type deallocate_is_noop.
+template<typename Allocator, typename = void>
+struct DeallocateIsNoop : std::false_type {
+};
+
+template<typename Allocator>
+struct DeallocateIsNoop<Allocator, decltype(void(
+    typename Allocator::deallocate_is_noop()))>
+    : Allocator::deallocate_is_noop {
+};
+
+// Algorithms on nodes linked through ListNodeBase, shared by TList and
+// TIntrusiveList. less compares two nodes. A chain is linked through next
+// and ended by nullptr, its prev links are not kept; the chain algorithms
+// take any Node with next, so TForwardList sorts and merges with them too.
+struct ListChains {
+  // Moves the nodes from first to last, inclusive, from their list to the
+  // one of position, right before it.
+  static void Transfer(ListNodeBase* const position,
+                       ListNodeBase* const first,
+                       ListNodeBase* const last) {
+    first->prev->next = last->next;
+    last->next->prev = first->prev;
+    Link(position, first, last);
+  }
+
+  // Links the nodes from first to last, inclusive, right before position.
+  // Their old links are not touched.
+  static void Link(ListNodeBase* const position,
+                   ListNodeBase* const first,
+                   ListNodeBase* const last) {
+    ListNodeBase* const left = position->prev;
+    left->next = first;
+    first->prev = left;
+    last->next = position;
+    position->prev = last;
+  }
+
+  // Moves the nodes of the list from into the list into, both sorted by
+  // less, in one pass: nodes of from which go before the same node of into
+  // are moved at once. Nodes of into go first among equal ones. moved counts
+  // the moved nodes, from has from_size of them.
+  // If less throws, both lists stay sorted, and the nodes which were already
+  // moved stay in into.
+  template<typename Less>
+  static void MergeLists(ListNodeBase& into,
+                         ListNodeBase& from,
+                         const size_t from_size,
+                         size_t& moved,
+                         const Less& less) {
+    ListNodeBase* position = into.next;
+    // Nodes of from before rest are moved.
+    ListNodeBase* rest = from.next;
+    try {
+      while (position != &into && rest != &from) {
+        if (!less(rest, position)) {
+          position = position->next;
+          continue;
+        }
+        ListNodeBase* last = rest;
+        size_t count = 1;
+        while (last->next != &from && less(last->next, position)) {
+          last = last->next;
+          ++count;
+        }
+        ListNodeBase* const next = last->next;
+        Link(position, rest, last);
+        moved += count;
+        rest = next;
+      }
+    } catch (...) {
+      DropMoved(from, rest);
+      throw;
+    }
+    if (rest != &from) {
+      Link(&into, rest, from.prev);
+      moved = from_size;
+      rest = &from;
+    }
+    DropMoved(from, rest);
+  }
+
+  // Takes the moved nodes of MergeLists off list: it keeps its nodes from
+  // rest on.
+  static void DropMoved(ListNodeBase& list, ListNodeBase* const rest) {
+    list.next = rest;
+    if (rest == &list) {
+      list.prev = &list;
+    } else {
+      rest->prev = &list;
+    }
+  }
+
+  // Sorts the list of base, which has two nodes or more, by SortChain.
+  // If less throws, all nodes stay in the list in some order.
+  template<typename Less>
+  static void SortList(ListNodeBase& base, const Less& less) {
+    base.prev->next = nullptr;
+    ListNodeBase* chain = base.next;
+    try {
+      SortChain(chain, less);
+    } catch (...) {
+      LinkChain(base, chain);
+      throw;
+    }
+    LinkChain(base, chain);
+  }
+
+  // Merges the sorted chain from into the sorted chain into, both linked
+  // through next and ended by nullptr. Nodes of into go first among equal
+  // ones. If less throws, into gets all nodes of both in some order.
+  template<typename Node, typename Less>
+  static void MergeChains(Node*& into,
+                          Node* from,
+                          const Less& less) {
+    Node head;
+    Node* tail = &head;
+    Node* first = into;
+    try {
+      while (first && from) {
+        const bool take_from = less(from, first);
+        Node* const node = take_from ? from : first;
+        (take_from ? from : first) = node->next;
+        tail->next = node;
+        tail = node;
+      }
+    } catch (...) {
+      if (first) {
+        tail->next = first;
+        while (first->next) {
+          first = first->next;
+        }
+        first->next = from;
+      } else {
+        tail->next = from;
+      }
+      into = head.next;
+      throw;
+    }
+    tail->next = first ? first : from;
+    into = head.next;
+  }
+
+  // MergeChains which leaves from empty, also if less throws.
+  template<typename Node, typename Less>
+  static void MergeInto(Node*& into,
+                        Node*& from,
+                        const Less& less) {
+    Node* const taken = from;
+    from = nullptr;
+    MergeChains(into, taken, less);
+  }
+
+  // Takes the longest sorted run from the front of the chain rest, linked
+  // through next and ended by nullptr, and sets tail to its last node. A
+  // strictly descending run is reversed, so that equal nodes keep their
+  // order. less is called before anything is relinked, so rest stays as is
+  // if it throws.
+  template<typename Node, typename Less>
+  static Node* TakeRun(Node*& rest,
+                       Node*& tail,
+                       size_t& length,
+                       const Less& less) {
+    Node* const first = rest;
+    Node* last = first;
+    length = 1;
+    if (last->next && less(last->next, last)) {
+      do {
+        last = last->next;
+        ++length;
+      } while (last->next && less(last->next, last));
+      rest = last->next;
+      Node* reversed = nullptr;
+      for (Node* node = first; node != rest;) {
+        Node* const next = node->next;
+        node->next = reversed;
+        reversed = node;
+        node = next;
+      }
+      tail = first;
+      return reversed;
+    }
+    while (last->next && !less(last->next, last)) {
+      last = last->next;
+      ++length;
+    }
+    rest = last->next;
+    last->next = nullptr;
+    tail = last;
+    return first;
+  }
+
+  // Runs shorter than this are extended by insertion, which takes fewer
+  // comparisons than merging the short runs of random data one by one.
+  static const size_t kMinRun = 16;
+
+  // Inserts nodes from the front of rest into the sorted run ending at tail
+  // until it has kMinRun nodes. A node goes after the equal ones. less is
+  // called before a node is relinked, so both chains stay whole if it
+  // throws.
+  template<typename Node, typename Less>
+  static void ExtendRun(Node*& run,
+                        Node*& tail,
+                        size_t& length,
+                        Node*& rest,
+                        const Less& less) {
+    for (; length < kMinRun && rest; ++length) {
+      Node* const node = rest;
+      if (!less(node, tail)) {
+        rest = node->next;
+        tail->next = node;
+        tail = node;
+        node->next = nullptr;
+      } else if (less(node, run)) {
+        rest = node->next;
+        node->next = run;
+        run = node;
+      } else {
+        Node* prev = run;
+        while (!less(node, prev->next)) {
+          prev = prev->next;
+        }
+        rest = node->next;
+        node->next = prev->next;
+        prev->next = node;
+      }
+    }
+  }
+
+  static size_t FloorLog2(size_t x) {
+    size_t log = 0;
+    while (x >>= 1) {
+      ++log;
+    }
+    return log;
+  }
+
+  // Sorts the chain linked through next and ended by nullptr, merging its
+  // sorted runs. A run of n nodes goes to bin floor(log2(n)), after the runs
+  // of lower bins, which came right before it, are merged into it, and it is
+  // merged with the run of its bin if there is one. So only runs of similar
+  // lengths are merged, and sort takes O(n log n) comparisons for any runs.
+  // If less throws, chain still has all nodes in some order.
+  template<typename Node, typename Less>
+  static void SortChain(Node*& chain, const Less& less) {
+    // bins[i] is a sorted run of 2^i to 2^(i+1) - 1 nodes, earlier ones in
+    // higher bins.
+    Node* bins[64] = { };
+    size_t lengths[64] = { };
+    Node* rest = chain;
+    Node* lower = nullptr;
+    Node* carry = nullptr;
+    try {
+      while (rest) {
+        size_t length;
+        Node* tail;
+        carry = TakeRun(rest, tail, length, less);
+        ExtendRun(carry, tail, length, rest, less);
+        size_t bin = FloorLog2(length);
+        size_t lower_length = 0;
+        for (size_t i = 0; i != bin; ++i) {
+          if (bins[i]) {
+            MergeInto(bins[i], lower, less);
+            lower = bins[i];
+            bins[i] = nullptr;
+            lower_length += lengths[i];
+          }
+        }
+        if (lower) {
+          MergeInto(lower, carry, less);
+          carry = lower;
+          lower = nullptr;
+          length += lower_length;
+          bin = FloorLog2(length);
+        }
+        for (size_t i = 0; i <= bin; ++i) {
+          if (bins[i]) {
+            MergeInto(bins[i], carry, less);
+            carry = bins[i];
+            bins[i] = nullptr;
+            length += lengths[i];
+            bin = FloorLog2(length);
+          }
+        }
+        bins[bin] = carry;
+        lengths[bin] = length;
+        carry = nullptr;
+      }
+      for (size_t i = 0; i != 64; ++i) {
+        if (bins[i]) {
+          MergeInto(bins[i], carry, less);
+          carry = bins[i];
+          bins[i] = nullptr;
+        }
+      }
+      chain = carry;
+    } catch (...) {
+      // Every node is in a bin, lower, carry or rest.
+      Node head;
+      Node* tail = &head;
+      for (size_t i = 0; i != 64; ++i) {
+        tail = AppendChain(tail, bins[i]);
+      }
+      tail = AppendChain(tail, lower);
+      tail = AppendChain(tail, carry);
+      tail->next = rest;
+      chain = head.next;
+      throw;
+    }
+  }
+
+  // Links chain after tail, returns the new tail.
+  template<typename Node>
+  static Node* AppendChain(Node* tail, Node* const chain) {
+    tail->next = chain;
+    while (tail->next) {
+      tail = tail->next;
+    }
+    return tail;
+  }
+
+  // Makes the list of base of the chain, restoring prev links.
+  static void LinkChain(ListNodeBase& base, ListNodeBase* const chain) {
+    ListNodeBase* prev = &base;
+    for (ListNodeBase* node = chain; node; node = node->next) {
+      node->prev = prev;
+      prev = node;
+    }
+    base.next = prev == &base ? &base : chain;
+    base.prev = prev;
+    prev->next = &base;
+  }
+};
+
+template<typename T, typename Allocator = std::allocator<T>>
+class TList : private std::allocator_traits<Allocator>::template rebind_alloc<
+    ListNode<T>> {
+public:
+  typedef T value_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef ListIterator<T> iterator;
+  typedef ListConstIterator<T> const_iterator;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+  typedef Allocator allocator_type;
+
+private:
+  typedef typename std::allocator_traits<Allocator>::template rebind_alloc<
+      ListNode<value_type>> NodesAllocator;
+  typedef std::allocator_traits<NodesAllocator> NodesTraits;
+
+public:
+  // Strong guarantees (no changes in case of exception, i. e. all would be destroyed)
+  TList(const allocator_type& alloc = allocator_type())
+      : NodesAllocator(alloc) {
+  }
+
+  // Strong guarantees (no changes in case of exception, i. e. all would be destroyed)
+  TList(const TList& x)
+      : NodesAllocator(NodesTraits::select_on_container_copy_construction(
+            x.GetAllocator())) {
+    InsertRange(&base_, x.begin(), x.end(), std::forward_iterator_tag());
+  }
+
+  TList(TList&& x)
+      : NodesAllocator(std::move(x.GetAllocator())) {
+    SwapNodes(x);
+  }
+
+  // Strong guarantees (no changes in case of exception, i. e. all would be destroyed)
+  explicit TList(size_type n) {
+    DefaultAppend(n);
+  }
+
+  // Strong guarantees (no changes in case of exception, i. e. all would be destroyed)
+  TList(size_type n, const value_type& val, const allocator_type& alloc =
+            allocator_type())
+      : NodesAllocator(alloc) {
+    insert(end(), n, val);
+  }
+
+  // Strong guarantees (no changes in case of exception, i. e. all would be destroyed)
+  template<class InputIterator, typename = std::_RequireInputIter<
+      InputIterator>>
+  TList(InputIterator first,
+        InputIterator last,
+        const allocator_type& alloc = allocator_type())
+      : NodesAllocator(alloc) {
+    insert(end(), first, last);
+  }
+
+  ~TList() {
+    DestroyAll();
+  }
+
+  // Basic guarantees (no memory leak)
+  TList& operator=(const TList& x) {
+    if (this != &x) {
+      if (NodesTraits::propagate_on_container_copy_assignment::value
+          && GetAllocator() != x.GetAllocator()) {
+        // Nodes of this list can be given back only to its own allocator.
+        clear();
+      }
+      CopyAllocator(x.GetAllocator(), std::integral_constant<bool,
+          NodesTraits::propagate_on_container_copy_assignment::value>());
+      iterator my_first = begin();
+      iterator my_last = end();
+      const_iterator x_first = x.begin();
+      const_iterator x_last = x.end();
+      for (; my_first != my_last && x_first != x_last;
+          ++my_first, ++x_first) {
+        *my_first = *x_first;
+      }
+      if (x_first == x_last) {
+        erase(my_first, my_last);
+      } else {
+        insert(my_last, x_first, x_last);
+      }
+    }
+
+    return *this;
+  }
+
+  // The nodes of x are taken over if the allocator propagates or the
+  // allocators are equal, otherwise the elements are moved one by one.
+  TList& operator=(TList&& x) {
+    clear();
+    if (NodesTraits::propagate_on_container_move_assignment::value
+        || GetAllocator() == x.GetAllocator()) {
+      MoveAllocator(x.GetAllocator(), std::integral_constant<bool,
+          NodesTraits::propagate_on_container_move_assignment::value>());
+      SwapNodes(x);
+    } else {
+      insert(end(), std::make_move_iterator(x.begin()),
+          std::make_move_iterator(x.end()));
+    }
+    return *this;
+  }
+
+  // Strong guarantees (no changes in case of exception)
+  template<typename ... Args>
+  void emplace_back(Args&&... args) {
+    auto ptr = CreateNode(std::forward<Args>(args)...);
+    PtrsWork(ptr, ptr, &base_);
+  }
+
+  // Strong guarantees (no changes in case of exception)
+  template<typename ... Args>
+  void emplace_front(Args&&... args) {
+    auto ptr = CreateNode(std::forward<Args>(args)...);
+    PtrsWork(ptr, ptr, base_.next);
+  }
+
+  // Strong guarantees (no changes in case of exception)
+  void push_back(const value_type& val) {
+    insert(end(), val);
+  }
+  // Strong guarantees (no changes in case of exception)
+  void push_back(value_type&& val) {
+    emplace_back(std::move(val));
+  }
+
+  // Strong guarantees (no changes in case of exception)
+  void push_front(const value_type& val) {
+    insert(begin(), val);
+  }
+
+  // Strong guarantees (no changes in case of exception)
+  void push_front(value_type&& val) {
+    emplace_front(std::move(val));
+  }
+
+  void pop_back() noexcept {
+    erase(--end());
+  }
+
+  void pop_front() noexcept {
+    erase(begin());
+  }
+
+  iterator erase(const_iterator position) noexcept {
+    return erase(position, std::next(position));
+  }
+
+  iterator erase(const_iterator first, const_iterator last) noexcept {
+    auto first_ptr = const_cast<ListNodeBase*>(first.ptr);
+    auto last_ptr = const_cast<ListNodeBase*>(last.ptr);
+    if (first_ptr == last_ptr) {
+      return iterator(last_ptr);
+    }
+    const size_type count = first_ptr == base_.next && last_ptr == &base_ ?
+        size_ : std::distance(first, last);
+    auto my_left = first_ptr->prev;
+    auto my_right = last_ptr;
+    auto last_erased = my_right->prev;
+    my_right->prev = my_left;
+    if (!my_left) {
+      base_.next = my_right;
+    } else {
+      my_left->next = my_right;
+    }
+    size_ -= count;
+    ReleaseNodes(first_ptr, last_erased, count);
+
+    return iterator(my_right);
+  }
+
+  // Strong guarantees (no changes in case of exception)
+  void splice(const_iterator position,
+              TList&& x,
+              const_iterator first,
+              const_iterator last) noexcept {
+    const size_t size_delta = std::distance(first, last);
+
+    Splice(position, std::move(x), first, last);
+
+    x.size_ -= size_delta;
+    size_ += size_delta;
+  }
+
+  // Strong guarantees (no changes in case of exception)
+  void splice(const_iterator position,
+              TList& x,
+              const_iterator first,
+              const_iterator last) noexcept {
+    splice(position, std::move(x), first, last);
+  }
+
+  // Strong guarantees (no changes in case of exception)
+  void splice(const_iterator position, TList&& x) noexcept {
+    if (!x.empty()) {
+      Splice(position, std::move(x), x.begin(), x.end());
+      size_ += x.size_;
+      x.size_ = 0;
+    }
+  }
+
+  // Strong guarantees (no changes in case of exception)
+  void splice(const_iterator position, TList& x) noexcept {
+    splice(position, std::move(x));
+  }
+
+  // Strong guarantees (no changes in case of exception)
+  iterator insert(const_iterator position, const value_type& val) {
+    auto new_ptr = CreateNode(val);
+    auto right_ptr = const_cast<ListNodeBase*>(position.ptr);
+    PtrsWork(new_ptr, new_ptr, right_ptr);
+    return iterator(new_ptr);
+  }
+
+  // Strong guarantees (no changes in case of exception)
+  iterator insert(const_iterator position,
+                  size_type n,
+                  const value_type& val) {
+    return InsertNodes(const_cast<ListNodeBase*>(position.ptr), n,
+        [this, &val](ListNode<value_type>* const node) {
+          NodesTraits::construct(GetAllocator(), node, val);
+        });
+  }
+
+  // Strong guarantees (no changes in case of exception)
+  template<class InputIterator>
+  iterator insert(const_iterator position,
+                  InputIterator first,
+                  InputIterator last) {
+    return InsertRange(const_cast<ListNodeBase*>(position.ptr), first, last,
+        typename std::iterator_traits<InputIterator>::iterator_category());
+  }
+
+  iterator begin() {
+    return iterator(base_.next);
+  }
+
+  const_iterator begin() const {
+    return const_iterator(base_.next);
+  }
+
+  const_iterator cbegin() const {
+    return const_iterator(base_.next);
+  }
+
+  iterator end() {
+    return iterator(&base_);
+  }
+
+  const_iterator end() const {
+    return const_iterator(&base_);
+  }
+
+  const_iterator cend() const {
+    return const_iterator(&base_);
+  }
+
+  bool empty() const {
+    return base_.next == &base_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  allocator_type get_allocator() const {
+    return allocator_type(GetAllocator());
+  }
+
+  reference front() {
+    return *begin();
+  }
+
+  const_reference front() const {
+    return *begin();
+  }
+
+  reference back() {
+    iterator tmp = end();
+    --tmp;
+    return *tmp;
+  }
+
+  const_reference back() const {
+    const_iterator tmp = end();
+    --tmp;
+    return *tmp;
+  }
+
+  // Basic guarantees (no memory leak)
+  void assign(size_type n, const value_type& val) {
+    iterator i = begin();
+    for (; i != end() && n > 0; ++i, --n) {
+      *i = val;
+    }
+    if (n > 0) {
+      insert(end(), n, val);
+    } else {
+      erase(i, end());
+    }
+  }
+
+  // The allocators are swapped only if they propagate on swap, otherwise
+  // they must be equal.
+  void swap(TList& x) {
+    SwapNodes(x);
+    SwapAllocators(x, std::integral_constant<bool,
+        NodesTraits::propagate_on_container_swap::value>());
+  }
+
+  // Strong guarantees (no changes in case of exception)
+  void resize(size_type new_size) {
+    while (size_ > new_size) {
+      erase(--end());
+    }
+    if (size_ < new_size) {
+      DefaultAppend(new_size - size_);
+    }
+  }
+
+  // Strong guarantees (no changes in case of exception)
+  void resize(size_type new_size, const value_type& val) {
+    while (size_ > new_size) {
+      erase(--end());
+    }
+    if (size_ < new_size) {
+      insert(end(), new_size - size_, val);
+    }
+  }
+
+  void clear() noexcept {
+    erase(begin(), end());
+  }
+
+  void reverse() noexcept {
+    if (!empty() && base_.prev != base_.next) {
+      auto current_ptr = base_.next;
+      while (current_ptr != &base_) {
+        auto next = current_ptr->next;
+        std::swap(current_ptr->prev, current_ptr->next);
+        current_ptr = next;
+      }
+      base_.next->next = &base_;
+      base_.prev->prev = &base_;
+      auto new_before_tail = base_.next;
+      base_.next = base_.prev;
+      base_.prev = new_before_tail;
+    }
+  }
+
+  void merge(TList&& x) {
+    merge(std::move(x), ElementsLess());
+  }
+
+  void merge(TList& x) {
+    merge(std::move(x), ElementsLess());
+  }
+
+  // Moves the nodes of x into the list, both sorted by comp, in one pass.
+  // Elements of the list go first among equal ones. The allocators must be
+  // equal.
+  // If a comparison throws, both lists stay sorted, and the elements of x
+  // which were already moved stay in this one.
+  template<typename Compare>
+  void merge(TList&& x, Compare comp) {
+    if (this == &x || x.empty()) {
+      return;
+    }
+    size_type moved = 0;
+    try {
+      ListChains::MergeLists(base_, x.base_, x.size_, moved,
+          NodesLess<Compare>(comp));
+    } catch (...) {
+      x.size_ -= moved;
+      size_ += moved;
+      throw;
+    }
+    x.size_ -= moved;
+    size_ += moved;
+  }
+
+  template<typename Compare>
+  void merge(TList& x, Compare comp) {
+    merge(std::move(x), comp);
+  }
+
+  // Stable merge sort of the nodes in place, no list or allocation is made,
+  // so stateful allocators work as is. Runs already in order, or in strictly
+  // reverse order, are taken as a whole, so nearly sorted lists take about
+  // one pass.
+  // If a comparison throws, all elements stay in the list in some order.
+  void sort() {
+    sort(ElementsLess());
+  }
+
+  template<typename Compare>
+  void sort(Compare comp) {
+    // Let's do nothing if the list has length 0 or 1.
+    if (size_ < 2) {
+      return;
+    }
+    ListChains::SortList(base_, NodesLess<Compare>(comp));
+  }
+
+  // Stable sort on the threads of pool. The list is cut into segments which
+  // are sorted in parallel, then neighbouring segments are merged in pairs,
+  // in parallel too, until one is left. Like sort(), only the links of the
+  // nodes change: nothing is allocated, copied or moved. Lists of less than
+  // kMinParallelSortSegment nodes per thread are sorted by sort().
+  // Pool is any type with ThreadsCount() and Run(count, task) which calls
+  // task(i) for i in [0, count) and returns when all calls are done, as
+  // TThreadPool of thread_pool.h. comp is called from several threads at
+  // once.
+  // If a comparison throws, all elements stay in the list in some order.
+  template<typename Pool>
+  void parallel_sort(Pool& pool) {
+    parallel_sort(pool, ElementsLess());
+  }
+
+  template<typename Pool, typename Compare>
+  void parallel_sort(Pool& pool, Compare comp) {
+    const size_t segments_count = std::min(std::min(pool.ThreadsCount() + 1,
+        size_ / kMinParallelSortSegment), size_t(kMaxParallelSortSegments));
+    if (segments_count < 2) {
+      sort(comp);
+      return;
+    }
+    ListNodeBase* segments[kMaxParallelSortSegments];
+    base_.prev->next = nullptr;
+    ListNodeBase* node = base_.next;
+    for (size_t i = 0; i != segments_count; ++i) {
+      segments[i] = node;
+      // Earlier segments take the remainder, one node each.
+      size_type length = size_ / segments_count
+          + (i < size_ % segments_count ? 1 : 0);
+      while (--length != 0) {
+        node = node->next;
+      }
+      ListNodeBase* const next = node->next;
+      node->next = nullptr;
+      node = next;
+    }
+    const NodesLess<Compare> less(comp);
+    size_t count = segments_count;
+    try {
+      pool.Run(count, [&segments, &less](const size_t i) {
+        ListChains::SortChain(segments[i], less);
+      });
+      for (; count != 1; count = (count + 1) / 2) {
+        // The odd segment at the end waits for the next round.
+        pool.Run(count / 2, [&segments, &less](const size_t i) {
+          ListChains::MergeInto(segments[2 * i], segments[2 * i + 1], less);
+        });
+        for (size_t i = 1; i != (count + 1) / 2; ++i) {
+          segments[i] = segments[2 * i];
+        }
+      }
+    } catch (...) {
+      // Failed calls left their nodes in segments too.
+      ListNodeBase head;
+      ListNodeBase* tail = &head;
+      for (size_t i = 0; i != count; ++i) {
+        tail = ListChains::AppendChain(tail, segments[i]);
+      }
+      ListChains::LinkChain(base_, head.next);
+      throw;
+    }
+    ListChains::LinkChain(base_, segments[0]);
+  }
+
+  // Stable sort which puts pointers to the nodes into an array, sorts the
+  // array and relinks the list in one pass. Faster than sort() on long lists
+  // of scattered nodes, but takes memory for size() pointers (and a buffer
+  // of std::stable_sort) from std::allocator.
+  // Strong guarantees (no changes in case of exception)
+  void sort_by_pointers() {
+    sort_by_pointers(ElementsLess());
+  }
+
+  template<typename Compare>
+  void sort_by_pointers(Compare comp) {
+    if (size_ < 2) {
+      return;
+    }
+    std::vector<ListNodeBase*> nodes;
+    nodes.reserve(size_);
+    for (ListNodeBase* node = base_.next; node != &base_; node = node->next) {
+      nodes.push_back(node);
+    }
+    std::stable_sort(nodes.begin(), nodes.end(), NodesLess<Compare>(comp));
+    ListNodeBase* prev = &base_;
+    for (ListNodeBase* const node : nodes) {
+      prev->next = node;
+      node->prev = prev;
+      prev = node;
+    }
+    prev->next = &base_;
+    base_.prev = prev;
+  }
+
+  // Moves the elements into fresh nodes allocated in list order, each batch
+  // sorted by address, and frees the old nodes, so that a list scattered by
+  // erases, splices and sort() is walked forward through memory again.
+  // Invalidates all iterators, pointers and references.
+  // Strong guarantees if value_type is copyable or nothrow movable, basic
+  // otherwise (no memory leak)
+  void compact() {
+    if (size_ < 2) {
+      return;
+    }
+    ListNodeBase* source = base_.next;
+    const iterator first = InsertNodes(&base_, size_,
+        [this, &source](ListNode<value_type>* const node) {
+          NodesTraits::construct(GetAllocator(), node, std::move_if_noexcept(
+              static_cast<ListNode<value_type>*>(source)->data));
+          source = source->next;
+        }, true);
+    erase(begin(), first);
+  }
+
+  // Basic guarantees (elements removed before an exception stay removed, no
+  // memory leak)
+  void unique() {
+    if (empty()) {
+      return;
+    }
+    RemovedNodes removed;
+    ListNodeBase* kept = base_.next;
+    ListNodeBase* ptr = kept->next;
+    try {
+      while (ptr != &base_) {
+        ListNodeBase* const next = ptr->next;
+        if (static_cast<ListNode<value_type>*>(kept)->data
+            == static_cast<ListNode<value_type>*>(ptr)->data) {
+          Unlink(ptr);
+          removed.Add(ptr);
+        } else {
+          kept = ptr;
+        }
+        ptr = next;
+      }
+    } catch (...) {
+      ReleaseNodes(removed.first, removed.last, removed.count);
+      throw;
+    }
+    ReleaseNodes(removed.first, removed.last, removed.count);
+  }
+
+  // Removes the elements equal to value. value may be an element of the list.
+  void remove(const value_type& value) {
+    remove_if([&value](const value_type& element) {
+      return element == value;
+    });
+  }
+
+  // Basic guarantees (elements removed before an exception stay removed, no
+  // memory leak)
+  template<typename Predicate>
+  void remove_if(Predicate pred) {
+    RemovedNodes removed;
+    ListNodeBase* ptr = base_.next;
+    try {
+      while (ptr != &base_) {
+        ListNodeBase* const next = ptr->next;
+        if (pred(static_cast<ListNode<value_type>*>(ptr)->data)) {
+          Unlink(ptr);
+          removed.Add(ptr);
+        }
+        ptr = next;
+      }
+    } catch (...) {
+      ReleaseNodes(removed.first, removed.last, removed.count);
+      throw;
+    }
+    ReleaseNodes(removed.first, removed.last, removed.count);
+  }
+
+private:
+  void DestroyAll() {
+    erase(begin(), end());
+  }
+
+  NodesAllocator& GetAllocator() {
+    return *static_cast<NodesAllocator*>(this);
+  }
+
+  const NodesAllocator& GetAllocator() const {
+    return *static_cast<const NodesAllocator*>(this);
+  }
+
+  void SwapNodes(TList& x) {
+    base_.swap(x.base_);
+    std::swap(size_, x.size_);
+  }
+
+  void SwapAllocators(TList& x, std::true_type) {
+    using std::swap;
+    swap(GetAllocator(), x.GetAllocator());
+  }
+
+  void SwapAllocators(TList&, std::false_type) {
+  }
+
+  void CopyAllocator(const NodesAllocator& allocator, std::true_type) {
+    GetAllocator() = allocator;
+  }
+
+  void CopyAllocator(const NodesAllocator&, std::false_type) {
+  }
+
+  void MoveAllocator(NodesAllocator& allocator, std::true_type) {
+    GetAllocator() = std::move(allocator);
+  }
+
+  void MoveAllocator(NodesAllocator&, std::false_type) {
+  }
+
+  // Strong guarantees (no changes in case of exception)
+  void DefaultAppend(size_type n) {
+    InsertNodes(&base_, n, [this](ListNode<value_type>* const node) {
+      NodesTraits::construct(GetAllocator(), node);
+    });
+  }
+
+  // Strong guarantees (no changes in case of exception)
+  template<class ForwardIterator>
+  iterator InsertRange(ListNodeBase* const position,
+                       ForwardIterator first,
+                       ForwardIterator last,
+                       std::forward_iterator_tag) {
+    return InsertNodes(position, std::distance(first, last),
+        [this, &first](ListNode<value_type>* const node) {
+          NodesTraits::construct(GetAllocator(), node, *first);
+          ++first;
+        });
+  }
+
+  // Strong guarantees (no changes in case of exception)
+  template<class InputIterator>
+  iterator InsertRange(ListNodeBase* const position,
+                       InputIterator first,
+                       InputIterator last,
+                       std::input_iterator_tag) {
+    // The length is unknown, build the nodes aside one by one.
+    TList tmp(GetAllocator());
+    for (; first != last; ++first) {
+      tmp.emplace_back(*first);
+    }
+    if (tmp.empty()) {
+      return iterator(position);
+    }
+    iterator iter = tmp.begin();
+    splice(const_iterator(position), tmp);
+    return iter;
+  }
+
+  // Nodes of the bulk paths are allocated kBatchSize at a time.
+  static const size_type kBatchSize = 64;
+
+  void AllocateNodes(ListNode<value_type>** const nodes,
+                     const size_type count,
+                     std::true_type) {
+    this->allocate_batch(nodes, count);
+  }
+
+  void AllocateNodes(ListNode<value_type>** const nodes,
+                     const size_type count,
+                     std::false_type) {
+    size_type allocated = 0;
+    try {
+      for (; allocated != count; ++allocated) {
+        nodes[allocated] = NodesTraits::allocate(GetAllocator(), 1);
+      }
+    } catch (...) {
+      DeallocateNodes(nodes, allocated, std::false_type());
+      throw;
+    }
+  }
+
+  void DeallocateNodes(ListNode<value_type>** const nodes,
+                       const size_type count,
+                       std::true_type) {
+    this->deallocate_batch(nodes, count);
+  }
+
+  void DeallocateNodes(ListNode<value_type>** const nodes,
+                       const size_type count,
+                       std::false_type) {
+    for (size_type i = 0; i != count; ++i) {
+      NodesTraits::deallocate(GetAllocator(), nodes[i], 1);
+    }
+  }
+
+  // Nodes taken out of the list, linked through next to be released at once.
+  struct RemovedNodes {
+    ListNodeBase* first = nullptr;
+    ListNodeBase* last = nullptr;
+    size_type count = 0;
+
+    void Add(ListNodeBase* const node) {
+      if (last == nullptr) {
+        first = node;
+      } else {
+        last->next = node;
+      }
+      last = node;
+      ++count;
+    }
+  };
+
+  // Takes node out of the list, keeping its own links.
+  void Unlink(ListNodeBase* const node) {
+    auto my_left = node->prev;
+    auto my_right = node->next;
+    my_right->prev = my_left;
+    if (!my_left) {
+      base_.next = my_right;
+    } else {
+      my_left->next = my_right;
+    }
+    --size_;
+  }
+
+  // Destroys and deallocates count nodes linked through next from first to
+  // last. Nodes of trivially destructible elements go back to an allocator
+  // with deallocate_chain in one call, as they are already linked through
+  // their first bytes. If deallocate does nothing, the nodes are only
+  // destroyed, and not even walked for trivially destructible elements.
+  void ReleaseNodes(ListNodeBase* const first,
+                    ListNodeBase* const last,
+                    const size_type count) {
+    if (DeallocateIsNoop<NodesAllocator>::value) {
+      if (!std::is_trivially_destructible<value_type>::value) {
+        ListNodeBase* node = first;
+        for (size_type i = 0; i != count; ++i) {
+          ListNodeBase* const next = node->next;
+          NodesTraits::destroy(GetAllocator(),
+              static_cast<ListNode<value_type>*>(node));
+          node = next;
+        }
+      }
+      return;
+    }
+    ReleaseNodes(first, last, count, std::integral_constant<bool,
+        HasChainDeallocation<NodesAllocator>::value
+            && std::is_trivially_destructible<value_type>::value>());
+  }
+
+  void ReleaseNodes(ListNodeBase* const first,
+                    ListNodeBase* const last,
+                    const size_type count,
+                    std::true_type) {
+    if (count != 0) {
+      this->deallocate_chain(static_cast<ListNode<value_type>*>(first),
+          static_cast<ListNode<value_type>*>(last), count);
+    }
+  }
+
+  void ReleaseNodes(ListNodeBase* const first,
+                    ListNodeBase*,
+                    const size_type count,
+                    std::false_type) {
+    DestroyNodes(first, count);
+  }
+
+  // parallel_sort cuts lists into at most kMaxParallelSortSegments segments
+  // of at least kMinParallelSortSegment nodes.
+  static const size_t kMaxParallelSortSegments = 64;
+  static const size_t kMinParallelSortSegment = 16384;
+
+  // operator< of the elements, what sort() and merge() use by default.
+  struct ElementsLess {
+    bool operator()(const value_type& x, const value_type& y) const {
+      return x < y;
+    }
+  };
+
+  // Compares nodes by their elements.
+  template<typename Compare>
+  struct NodesLess {
+    explicit NodesLess(Compare& comp)
+        : comp(comp) {
+    }
+
+    bool operator()(ListNodeBase* const x, ListNodeBase* const y) const {
+      return comp(static_cast<ListNode<value_type>*>(x)->data,
+          static_cast<ListNode<value_type>*>(y)->data);
+    }
+
+    Compare& comp;
+  };
+
+  // Destroys count nodes linked through next starting from first, and gives
+  // their memory back kBatchSize nodes at a time.
+  void DestroyNodes(ListNodeBase* first, size_type count) {
+    ListNode<value_type>* nodes[kBatchSize];
+    while (count != 0) {
+      const size_type batch_size = std::min(count, size_type(kBatchSize));
+      for (size_type i = 0; i != batch_size; ++i) {
+        nodes[i] = static_cast<ListNode<value_type>*>(first);
+        first = first->next;
+        NodesTraits::destroy(GetAllocator(), nodes[i]);
+      }
+      DeallocateNodes(nodes, batch_size,
+          HasBatchAllocation<NodesAllocator>());
+      count -= batch_size;
+    }
+  }
+
+  // Inserts n nodes before position, construct(node) constructs each of them
+  // in order. The nodes are allocated in batches and linked aside, and are
+  // put into the list only when all of them are constructed. Returns the
+  // first inserted node, or position if n is 0. With address_order the nodes
+  // of every batch are linked in the order of their addresses.
+  // Strong guarantees (no changes in case of exception)
+  template<typename Construct>
+  iterator InsertNodes(ListNodeBase* const position,
+                       const size_type n,
+                       Construct construct,
+                       const bool address_order = false) {
+    ListNodeBase* first = nullptr;
+    ListNodeBase* last = nullptr;
+    size_type constructed = 0;
+    ListNode<value_type>* nodes[kBatchSize];
+    size_type batch_size = 0;
+    size_type batch_constructed = 0;
+    try {
+      while (constructed != n) {
+        batch_size = 0;
+        batch_constructed = 0;
+        const size_type to_allocate = std::min(n - constructed,
+            size_type(kBatchSize));
+        AllocateNodes(nodes, to_allocate,
+            HasBatchAllocation<NodesAllocator>());
+        batch_size = to_allocate;
+        if (address_order) {
+          std::sort(nodes, nodes + batch_size,
+              std::less<ListNode<value_type>*>());
+        }
+        for (; batch_constructed != batch_size; ++batch_constructed) {
+          ListNode<value_type>* const node = nodes[batch_constructed];
+          construct(node);
+          node->prev = last;
+          if (last == nullptr) {
+            first = node;
+          } else {
+            last->next = node;
+          }
+          last = node;
+          ++constructed;
+        }
+      }
+    } catch (...) {
+      // The chunks which did not get a node yet go back in one batch.
+      DeallocateNodes(nodes + batch_constructed,
+          batch_size - batch_constructed,
+          HasBatchAllocation<NodesAllocator>());
+      DestroyNodes(first, constructed);
+      throw;
+    }
+
+    if (first == nullptr) {
+      return iterator(position);
+    }
+    PtrsWork(first, last, position);
+    size_ += n;
+    return iterator(first);
+  }
+
+  // Strong guarantees
+  template<typename ... Args>
+  ListNode<value_type>* CreateNode(Args&&... args) {
+    ListNode<value_type>* ptr(NodesTraits::allocate(GetAllocator(), 1));
+    try {
+      NodesTraits::construct(GetAllocator(), ptr,
+          std::forward<Args>(args)...);
+    } catch (...) {
+      NodesTraits::deallocate(GetAllocator(), ptr, 1);
+      throw;
+    }
+
+    ++size_;
+    return ptr;
+  }
+
+  // Some rountine work with ptrs. new_left and new_right are first and last
+  // nodes of inserted diapason. new_left and new_right might be equal.
+  // my_right_ptr - is old node which already existed. new nodes are inserted right before it.
+  void PtrsWork(ListNodeBase* new_left,
+                ListNodeBase* new_right,
+                ListNodeBase* my_right_ptr) {
+    auto my_left = my_right_ptr->prev;
+    my_right_ptr->prev = new_right;
+    new_right->next = my_right_ptr;
+    new_left->prev = my_left;
+    if (!my_left) {
+      base_.next = new_left;
+    } else {
+      my_left->next = new_left;
+    }
+  }
+
+  void Splice(const_iterator position,
+              TList&&,
+              const_iterator first,
+              const_iterator last) noexcept {
+    ListChains::Transfer(const_cast<ListNodeBase*>(position.ptr),
+        const_cast<ListNodeBase*>(first.ptr),
+        const_cast<ListNodeBase*>((--last).ptr));
+  }
+
+  ListNodeBase base_;
+  size_t size_ = 0;
+};
+
+
+
+template<typename T>
+inline bool operator==(const ListIterator<T>& x,
+                       const ListConstIterator<T>& y) noexcept
+                       {
+  return x.ptr == y.ptr;
+}
+
+template<typename T>
+inline bool operator!=(const ListIterator<T>& x,
+                       const ListConstIterator<T>& y) noexcept
+                       {
+  return x.ptr != y.ptr;
+}
+
+template<typename T, typename Alloc>
+inline bool operator==(const TList<T, Alloc>& x,
+                       const TList<T, Alloc>& y) {
+  typedef typename TList<T, Alloc>::const_iterator const_iterator;
+  const_iterator end1 = x.end();
+  const_iterator end2 = y.end();
+
+  const_iterator i1 = x.begin();
+  const_iterator i2 = y.begin();
+  while (i1 != end1 && i2 != end2 && *i1 == *i2) {
+    ++i1;
+    ++i2;
+  }
+  return i1 == end1 && i2 == end2;
+}
+
+
+
+template<typename T, typename Alloc>
+inline bool operator==(const TList<T, Alloc>& x,
+                       const std::list<T, Alloc>& y) {
+  typedef typename TList<T, Alloc>::const_iterator const_iterator;
+  typedef typename std::list<T, Alloc>::const_iterator std_const_iterator;
+  const_iterator end1 = x.end();
+  std_const_iterator end2 = y.end();
+
+  const_iterator i1 = x.begin();
+  std_const_iterator i2 = y.begin();
+  while (i1 != end1 && i2 != end2 && *i1 == *i2) {
+    ++i1;
+    ++i2;
+  }
+  return i1 == end1 && i2 == end2 && x.size() == y.size();
+}
+
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+
+// TList of std::pmr, see also TFastMemoryResource in fast_memory_resource.h.
+template<typename T>
+using TPmrList = TList<T, std::pmr::polymorphic_allocator<T>>;
+#endif
+#endif
+
+#endif /* LST_H_ */
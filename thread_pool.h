@@ -0,0 +1,267 @@
+/*
+ * thread_pool.h
+ *
+ * Fixed set of worker threads for fork-join work, e.g. TList::parallel_sort
+ * and the algorithms of list_algorithms.h. Run(count, task) calls task(0) ..
+ * task(count - 1) on the workers and on the calling thread and returns when
+ * all calls are done. The indices are dealt out by work stealing: every
+ * thread gets a contiguous range of them, and takes half of the biggest
+ * range left when its own one runs out.
+ */
+
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <cstddef>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TThreadPool {
+public:
+  // A pool of 0 threads runs everything on the calling thread.
+  explicit TThreadPool(const size_t threads_count =
+                           DefaultThreadsCount())
+      : stopping(false) {
+    threads.reserve(threads_count);
+    try {
+      for (size_t i = 0; i != threads_count; ++i) {
+        // Range 0 of every job belongs to the thread which runs it.
+        threads.emplace_back([this, i] {
+          Work(i + 1);
+        });
+      }
+    } catch (...) {
+      Stop();
+      throw;
+    }
+  }
+
+  TThreadPool(const TThreadPool& other) = delete;
+
+  ~TThreadPool() {
+    Stop();
+  }
+
+  TThreadPool& operator=(const TThreadPool& other) = delete;
+
+  // Threads besides the calling one.
+  size_t ThreadsCount() const {
+    return threads.size();
+  }
+
+  // Calls task(i) for every i in [0, count), each once, on the threads of the
+  // pool and on the calling thread, and returns when all calls are done.
+  // task may call Run itself. If calls throw, the first exception is
+  // rethrown, after all calls are done.
+  template<typename Task>
+  void Run(const size_t count, Task task) {
+    if (count == 0) {
+      return;
+    }
+    Job job(count, std::min(count, threads.size() + 1),
+        [&task](const size_t index) {
+          task(index);
+        });
+    if (count > 1 && !threads.empty()) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(&job);
+      }
+      if (count == 2) {
+        work_available.notify_one();
+      } else {
+        work_available.notify_all();
+      }
+    }
+    job.Work(0);
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      // Workers only leave the job under mutex, so it is not touched after
+      // this.
+      job_done.wait(lock, [&job] {
+        return job.done == job.count && job.workers == 0;
+      });
+      const auto position = std::find(jobs.begin(), jobs.end(), &job);
+      if (position != jobs.end()) {
+        jobs.erase(position);
+      }
+    }
+    if (job.exception) {
+      std::rethrow_exception(job.exception);
+    }
+  }
+
+  static size_t DefaultThreadsCount() {
+    const size_t hardware_threads = std::thread::hardware_concurrency();
+    return hardware_threads > 1 ? hardware_threads - 1 : 0;
+  }
+
+private:
+  // Indices of calls not taken yet, [begin, end).
+  struct Range {
+    Range()
+        : begin(0), end(0) {
+    }
+
+    // Takes the first index, if any.
+    bool TakeFront(size_t& index) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (begin == end) {
+        return false;
+      }
+      index = begin++;
+      return true;
+    }
+
+    size_t Size() {
+      std::lock_guard<std::mutex> lock(mutex);
+      return end - begin;
+    }
+
+    std::mutex mutex;
+    size_t begin;
+    size_t end;
+  };
+
+  // Calls of one Run. Thread i works on ranges[i] first, there are fewer
+  // ranges than threads for short jobs, so threads past them only steal.
+  struct Job {
+    Job(const size_t count,
+        const size_t ranges_count,
+        std::function<void(size_t)> task)
+        : count(count), task(std::move(task)), ranges_count(ranges_count),
+          ranges(new Range[ranges_count]), taken(0), done(0), workers(0) {
+      for (size_t i = 0; i != ranges_count; ++i) {
+        ranges[i].begin = count * i / ranges_count;
+        ranges[i].end = count * (i + 1) / ranges_count;
+      }
+    }
+
+    // Makes calls until there are none left, stealing from the ranges of the
+    // other threads when the own one is empty.
+    void Work(const size_t thread) {
+      Range* const own = thread < ranges_count ? &ranges[thread] : nullptr;
+      size_t index;
+      while ((own != nullptr && own->TakeFront(index)) || Steal(own, index)) {
+        ++taken;
+        try {
+          task(index);
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(exception_mutex);
+          if (!exception) {
+            exception = std::current_exception();
+          }
+        }
+        ++done;
+      }
+    }
+
+    // Takes the first index of the back half of the biggest range. The rest
+    // of that half goes to own, if the thread has a range.
+    bool Steal(Range* const own, size_t& index) {
+      while (taken < count) {
+        Range* victim = nullptr;
+        size_t victim_size = 0;
+        for (size_t i = 0; i != ranges_count; ++i) {
+          const size_t size = ranges[i].Size();
+          if (size > victim_size) {
+            victim = &ranges[i];
+            victim_size = size;
+          }
+        }
+        if (victim == nullptr) {
+          return false;
+        }
+        size_t begin;
+        size_t end;
+        {
+          std::lock_guard<std::mutex> lock(victim->mutex);
+          if (victim->begin == victim->end) {
+            // Taken meanwhile, look again.
+            continue;
+          }
+          end = victim->end;
+          begin = own == nullptr ? end - 1
+              : victim->end - (victim->end - victim->begin + 1) / 2;
+          victim->end = begin;
+        }
+        index = begin;
+        if (begin + 1 != end) {
+          std::lock_guard<std::mutex> lock(own->mutex);
+          own->begin = begin + 1;
+          own->end = end;
+        }
+        return true;
+      }
+      return false;
+    }
+
+    const size_t count;
+    const std::function<void(size_t)> task;
+    const size_t ranges_count;
+    const std::unique_ptr<Range[]> ranges;
+    // Calls taken from the ranges, and calls done.
+    std::atomic<size_t> taken;
+    std::atomic<size_t> done;
+    // Workers in Work, guarded by the mutex of the pool.
+    size_t workers;
+    std::mutex exception_mutex;
+    std::exception_ptr exception;
+  };
+
+  void Work(const size_t thread) {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      work_available.wait(lock, [this] {
+        return stopping || !jobs.empty();
+      });
+      if (jobs.empty()) {
+        return;
+      }
+      Job* const job = jobs.front();
+      if (job->taken >= job->count) {
+        // All calls are taken, the ones in progress end without us.
+        jobs.pop_front();
+        continue;
+      }
+      ++job->workers;
+      lock.unlock();
+      job->Work(thread);
+      lock.lock();
+      --job->workers;
+      if (job->done == job->count && job->workers == 0) {
+        job_done.notify_all();
+      }
+    }
+  }
+
+  void Stop() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    work_available.notify_all();
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    threads.clear();
+  }
+
+  std::mutex mutex;
+  std::condition_variable work_available;
+  std::condition_variable job_done;
+  // Jobs with calls not taken yet, oldest first.
+  std::deque<Job*> jobs;
+  bool stopping;
+  std::vector<std::thread> threads;
+};
+
+#endif /* THREAD_POOL_H_ */
@@ -0,0 +1,691 @@
+/*
+ * unrolled_list.h
+ *
+ * TUnrolledList: a list whose nodes hold small arrays of elements, so that a
+ * scan walks memory mostly forward and pays a dependent load once per node
+ * instead of once per element. For small T it also takes a fraction of the
+ * memory of TList, whose every element carries two pointers.
+ */
+
+#ifndef UNROLLED_LIST_H_
+#define UNROLLED_LIST_H_
+
+#include <cstddef>
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "fast_allocator.h"
+
+struct UnrolledListNodeBase {
+  UnrolledListNodeBase* next;
+  UnrolledListNodeBase* prev;
+  // The elements of the node are in slots [begin, end). The list itself is a
+  // node without slots, begin and end stay 0 there.
+  unsigned begin;
+  unsigned end;
+
+  UnrolledListNodeBase()
+      : next(this), prev(this), begin(0), end(0) {
+  }
+};
+
+template<typename T, size_t Capacity>
+struct UnrolledListNode : public UnrolledListNodeBase {
+  typename std::aligned_storage<sizeof(T), alignof(T)>::type slots[Capacity];
+
+  // User-provided, so that constructing a node does not zero the slots.
+  UnrolledListNode() {
+  }
+
+  T* Slot(const size_t index) {
+    return reinterpret_cast<T*>(&slots[index]);
+  }
+};
+
+// Slots of a node of about NodeBytes bytes, at least two, so that a full
+// node can be split.
+template<typename T, size_t NodeBytes>
+struct UnrolledListCapacity : std::integral_constant<size_t,
+    (NodeBytes >= sizeof(UnrolledListNodeBase) + 2 * sizeof(T)
+        ? (NodeBytes - sizeof(UnrolledListNodeBase)) / sizeof(T) : 2)> {
+};
+
+template<typename T, size_t Capacity>
+struct UnrolledListIterator {
+  typedef UnrolledListNode<T, Capacity> Node;
+
+  typedef std::bidirectional_iterator_tag iterator_category;
+  typedef T value_type;
+  typedef T* pointer;
+  typedef T& reference;
+  typedef ptrdiff_t difference_type;
+
+  UnrolledListIterator(UnrolledListNodeBase* const node, const size_t index)
+      : node(node), index(index) {
+  }
+
+  reference operator*() const {
+    return *static_cast<Node*>(node)->Slot(index);
+  }
+
+  pointer operator->() const {
+    return static_cast<Node*>(node)->Slot(index);
+  }
+
+  UnrolledListIterator& operator++() {
+    if (++index == node->end) {
+      node = node->next;
+      index = node->begin;
+    }
+    return *this;
+  }
+
+  UnrolledListIterator operator++(int) {
+    UnrolledListIterator tmp = *this;
+    ++*this;
+    return tmp;
+  }
+
+  UnrolledListIterator& operator--() {
+    if (index == node->begin) {
+      node = node->prev;
+      index = node->end;
+    }
+    --index;
+    return *this;
+  }
+
+  UnrolledListIterator operator--(int) {
+    UnrolledListIterator tmp = *this;
+    --*this;
+    return tmp;
+  }
+
+  bool operator==(const UnrolledListIterator& other) const {
+    return node == other.node && index == other.index;
+  }
+
+  bool operator!=(const UnrolledListIterator& other) const {
+    return !(*this == other);
+  }
+
+  UnrolledListNodeBase* node;
+  size_t index;
+};
+
+template<typename T, size_t Capacity>
+struct UnrolledListConstIterator {
+  typedef UnrolledListNode<T, Capacity> Node;
+  typedef UnrolledListIterator<T, Capacity> iterator;
+
+  typedef std::bidirectional_iterator_tag iterator_category;
+  typedef T value_type;
+  typedef const T* pointer;
+  typedef const T& reference;
+  typedef ptrdiff_t difference_type;
+
+  UnrolledListConstIterator(const UnrolledListNodeBase* const node,
+                            const size_t index)
+      : node(node), index(index) {
+  }
+
+  UnrolledListConstIterator(const iterator& other)
+      : node(other.node), index(other.index) {
+  }
+
+  reference operator*() const {
+    return *const_cast<Node*>(static_cast<const Node*>(node))->Slot(index);
+  }
+
+  pointer operator->() const {
+    return const_cast<Node*>(static_cast<const Node*>(node))->Slot(index);
+  }
+
+  UnrolledListConstIterator& operator++() {
+    if (++index == node->end) {
+      node = node->next;
+      index = node->begin;
+    }
+    return *this;
+  }
+
+  UnrolledListConstIterator operator++(int) {
+    UnrolledListConstIterator tmp = *this;
+    ++*this;
+    return tmp;
+  }
+
+  UnrolledListConstIterator& operator--() {
+    if (index == node->begin) {
+      node = node->prev;
+      index = node->end;
+    }
+    --index;
+    return *this;
+  }
+
+  UnrolledListConstIterator operator--(int) {
+    UnrolledListConstIterator tmp = *this;
+    --*this;
+    return tmp;
+  }
+
+  bool operator==(const UnrolledListConstIterator& other) const {
+    return node == other.node && index == other.index;
+  }
+
+  bool operator!=(const UnrolledListConstIterator& other) const {
+    return !(*this == other);
+  }
+
+  const UnrolledListNodeBase* node;
+  size_t index;
+};
+
+// List of nodes of about NodeBytes bytes (two cache lines by default), each
+// holding up to kNodeCapacity elements. The nodes come from Allocator, the
+// fixed-size pools of TFastAllocator by default. Elements must be movable.
+//
+// Iterators, pointers and references:
+// - end() is the list itself and is never invalidated;
+// - push_back, push_front, emplace_back, emplace_front, pop_back and
+//   pop_front never move elements, so they only invalidate the erased
+//   element;
+// - insert and emplace in the middle move elements within the node of
+//   position, or split a full node in two, and invalidate all iterators into
+//   that node;
+// - erase invalidates the erased element and the elements after it in its
+//   node. A node is freed as soon as it is empty, nodes are not merged.
+template<typename T, typename Allocator = TFastAllocator<T>,
+    size_t NodeBytes = 128>
+class TUnrolledList : private std::allocator_traits<Allocator>::
+    template rebind_alloc<UnrolledListNode<T,
+        UnrolledListCapacity<T, NodeBytes>::value>> {
+public:
+  static const size_t kNodeCapacity = UnrolledListCapacity<T, NodeBytes>::value;
+
+  typedef T value_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef UnrolledListIterator<T, kNodeCapacity> iterator;
+  typedef UnrolledListConstIterator<T, kNodeCapacity> const_iterator;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+  typedef Allocator allocator_type;
+
+private:
+  typedef UnrolledListNode<T, kNodeCapacity> Node;
+  typedef typename std::allocator_traits<Allocator>::template rebind_alloc<
+      Node> NodesAllocator;
+  typedef std::allocator_traits<NodesAllocator> NodesTraits;
+
+public:
+  TUnrolledList(const allocator_type& alloc = allocator_type())
+      : NodesAllocator(alloc) {
+  }
+
+  // Strong guarantees (no changes in case of exception, i. e. all would be destroyed)
+  TUnrolledList(const TUnrolledList& x)
+      : NodesAllocator(NodesTraits::select_on_container_copy_construction(
+            x.GetAllocator())) {
+    try {
+      for (const auto& value : x) {
+        emplace_back(value);
+      }
+    } catch (...) {
+      clear();
+      throw;
+    }
+  }
+
+  TUnrolledList(TUnrolledList&& x)
+      : NodesAllocator(std::move(x.GetAllocator())) {
+    SwapNodes(x);
+  }
+
+  // Strong guarantees (no changes in case of exception, i. e. all would be destroyed)
+  template<class InputIterator, typename = typename std::enable_if<
+      std::is_convertible<typename std::iterator_traits<
+          InputIterator>::iterator_category, std::input_iterator_tag>::value>
+      ::type>
+  TUnrolledList(InputIterator first,
+                InputIterator last,
+                const allocator_type& alloc = allocator_type())
+      : NodesAllocator(alloc) {
+    try {
+      for (; first != last; ++first) {
+        emplace_back(*first);
+      }
+    } catch (...) {
+      clear();
+      throw;
+    }
+  }
+
+  ~TUnrolledList() {
+    clear();
+  }
+
+  // Basic guarantees (no memory leak)
+  TUnrolledList& operator=(const TUnrolledList& x) {
+    if (this != &x) {
+      // Nodes of this list can be given back only to its own allocator.
+      clear();
+      CopyAllocator(x.GetAllocator(), std::integral_constant<bool,
+          NodesTraits::propagate_on_container_copy_assignment::value>());
+      for (const auto& value : x) {
+        emplace_back(value);
+      }
+    }
+    return *this;
+  }
+
+  // The nodes of x are taken over if the allocator propagates or the
+  // allocators are equal, otherwise the elements are moved one by one.
+  TUnrolledList& operator=(TUnrolledList&& x) {
+    if (this != &x) {
+      clear();
+      if (NodesTraits::propagate_on_container_move_assignment::value
+          || GetAllocator() == x.GetAllocator()) {
+        MoveAllocator(x.GetAllocator(), std::integral_constant<bool,
+            NodesTraits::propagate_on_container_move_assignment::value>());
+        SwapNodes(x);
+      } else {
+        for (auto& value : x) {
+          emplace_back(std::move(value));
+        }
+        x.clear();
+      }
+    }
+    return *this;
+  }
+
+  iterator begin() {
+    return iterator(base_.next, base_.next->begin);
+  }
+
+  const_iterator begin() const {
+    return const_iterator(base_.next, base_.next->begin);
+  }
+
+  const_iterator cbegin() const {
+    return begin();
+  }
+
+  iterator end() {
+    return iterator(&base_, 0);
+  }
+
+  const_iterator end() const {
+    return const_iterator(&base_, 0);
+  }
+
+  const_iterator cend() const {
+    return end();
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  allocator_type get_allocator() const {
+    return allocator_type(GetAllocator());
+  }
+
+  reference front() {
+    return *begin();
+  }
+
+  const_reference front() const {
+    return *begin();
+  }
+
+  reference back() {
+    return *--end();
+  }
+
+  const_reference back() const {
+    return *--end();
+  }
+
+  // Strong guarantees (no changes in case of exception)
+  template<typename ... Args>
+  void emplace_back(Args&&... args) {
+    UnrolledListNodeBase* node = base_.prev;
+    if (node == &base_ || node->end == kNodeCapacity) {
+      node = LinkNode(CreateNode(0), &base_);
+      try {
+        Construct(node, 0, std::forward<Args>(args)...);
+      } catch (...) {
+        DestroyNode(node);
+        throw;
+      }
+    } else {
+      Construct(node, node->end, std::forward<Args>(args)...);
+    }
+    ++node->end;
+    ++size_;
+  }
+
+  // Strong guarantees (no changes in case of exception)
+  template<typename ... Args>
+  void emplace_front(Args&&... args) {
+    UnrolledListNodeBase* node = base_.next;
+    if (node == &base_ || node->begin == 0) {
+      node = LinkNode(CreateNode(kNodeCapacity), base_.next);
+      try {
+        Construct(node, kNodeCapacity - 1, std::forward<Args>(args)...);
+      } catch (...) {
+        DestroyNode(node);
+        throw;
+      }
+    } else {
+      Construct(node, node->begin - 1, std::forward<Args>(args)...);
+    }
+    --node->begin;
+    ++size_;
+  }
+
+  // Strong guarantees (no changes in case of exception)
+  void push_back(const value_type& val) {
+    emplace_back(val);
+  }
+
+  // Strong guarantees (no changes in case of exception)
+  void push_back(value_type&& val) {
+    emplace_back(std::move(val));
+  }
+
+  // Strong guarantees (no changes in case of exception)
+  void push_front(const value_type& val) {
+    emplace_front(val);
+  }
+
+  // Strong guarantees (no changes in case of exception)
+  void push_front(value_type&& val) {
+    emplace_front(std::move(val));
+  }
+
+  void pop_back() noexcept {
+    UnrolledListNodeBase* const node = base_.prev;
+    --node->end;
+    Destroy(node, node->end);
+    --size_;
+    if (node->begin == node->end) {
+      DestroyNode(node);
+    }
+  }
+
+  void pop_front() noexcept {
+    UnrolledListNodeBase* const node = base_.next;
+    Destroy(node, node->begin);
+    ++node->begin;
+    --size_;
+    if (node->begin == node->end) {
+      DestroyNode(node);
+    }
+  }
+
+  // Returns the inserted element.
+  // Basic guarantees (no memory leak) if moving an element of the node
+  // throws, strong otherwise
+  template<typename ... Args>
+  iterator emplace(const_iterator position, Args&&... args) {
+    if (position == cbegin()) {
+      emplace_front(std::forward<Args>(args)...);
+      return begin();
+    }
+    if (position == cend()) {
+      emplace_back(std::forward<Args>(args)...);
+      return --end();
+    }
+    UnrolledListNodeBase* node =
+        const_cast<UnrolledListNodeBase*>(position.node);
+    size_t index = position.index;
+    // Constructed aside first, so that args may refer to elements.
+    value_type value(std::forward<Args>(args)...);
+    if (index == node->begin && node->prev != &base_
+        && node->prev->end < kNodeCapacity) {
+      // Goes after the last element of the previous node.
+      node = node->prev;
+      Construct(node, node->end, std::move(value));
+      ++node->end;
+      ++size_;
+      return iterator(node, node->end - 1);
+    }
+    if (node->end - node->begin == kNodeCapacity) {
+      // The back half goes to a new node after this one.
+      UnrolledListNodeBase* const next = SplitNode(node);
+      if (index >= node->end) {
+        index -= node->end;
+        node = next;
+      }
+    }
+    if (node->end < kNodeCapacity) {
+      // Elements from index on move one slot forward.
+      if (index == node->end) {
+        Construct(node, index, std::move(value));
+      } else {
+        Construct(node, node->end, std::move(*Slot(node, node->end - 1)));
+        std::move_backward(Slot(node, index), Slot(node, node->end - 1),
+            Slot(node, node->end));
+        *Slot(node, index) = std::move(value);
+      }
+      ++node->end;
+    } else {
+      // Elements before index move one slot back.
+      if (index == node->begin) {
+        Construct(node, index - 1, std::move(value));
+      } else {
+        Construct(node, node->begin - 1,
+            std::move(*Slot(node, node->begin)));
+        std::move(Slot(node, node->begin + 1), Slot(node, index),
+            Slot(node, node->begin));
+        *Slot(node, index - 1) = std::move(value);
+      }
+      --node->begin;
+      --index;
+    }
+    ++size_;
+    return iterator(node, index);
+  }
+
+  iterator insert(const_iterator position, const value_type& val) {
+    return emplace(position, val);
+  }
+
+  iterator insert(const_iterator position, value_type&& val) {
+    return emplace(position, std::move(val));
+  }
+
+  // Returns the element after the erased one.
+  iterator erase(const_iterator position) {
+    UnrolledListNodeBase* const node =
+        const_cast<UnrolledListNodeBase*>(position.node);
+    const size_t index = position.index;
+    --size_;
+    if (index == node->begin) {
+      Destroy(node, index);
+      ++node->begin;
+    } else {
+      std::move(Slot(node, index + 1), Slot(node, node->end),
+          Slot(node, index));
+      --node->end;
+      Destroy(node, node->end);
+    }
+    if (node->begin == node->end) {
+      UnrolledListNodeBase* const next = node->next;
+      DestroyNode(node);
+      return iterator(next, next->begin);
+    }
+    if (index == node->end) {
+      return iterator(node->next, node->next->begin);
+    }
+    return iterator(node, std::max<size_t>(index, node->begin));
+  }
+
+  // Erasing moves elements, so last is not compared with while erasing.
+  iterator erase(const_iterator first, const_iterator last) {
+    iterator result(const_cast<UnrolledListNodeBase*>(first.node),
+        first.index);
+    for (size_t count = std::distance(first, last); count != 0; --count) {
+      result = erase(result);
+    }
+    return result;
+  }
+
+  void clear() noexcept {
+    UnrolledListNodeBase* node = base_.next;
+    while (node != &base_) {
+      UnrolledListNodeBase* const next = node->next;
+      for (size_t i = node->begin; i != node->end; ++i) {
+        Destroy(node, i);
+      }
+      NodesTraits::destroy(GetAllocator(), static_cast<Node*>(node));
+      NodesTraits::deallocate(GetAllocator(), static_cast<Node*>(node), 1);
+      node = next;
+    }
+    base_.next = base_.prev = &base_;
+    size_ = 0;
+  }
+
+  // The allocators are swapped only if they propagate on swap, otherwise
+  // they must be equal.
+  void swap(TUnrolledList& x) {
+    SwapNodes(x);
+    SwapAllocators(x, std::integral_constant<bool,
+        NodesTraits::propagate_on_container_swap::value>());
+  }
+
+private:
+  NodesAllocator& GetAllocator() {
+    return *static_cast<NodesAllocator*>(this);
+  }
+
+  const NodesAllocator& GetAllocator() const {
+    return *static_cast<const NodesAllocator*>(this);
+  }
+
+  static value_type* Slot(UnrolledListNodeBase* const node,
+                          const size_t index) {
+    return static_cast<Node*>(node)->Slot(index);
+  }
+
+  template<typename ... Args>
+  void Construct(UnrolledListNodeBase* const node,
+                 const size_t index,
+                 Args&&... args) {
+    NodesTraits::construct(GetAllocator(), Slot(node, index),
+        std::forward<Args>(args)...);
+  }
+
+  void Destroy(UnrolledListNodeBase* const node, const size_t index) {
+    NodesTraits::destroy(GetAllocator(), Slot(node, index));
+  }
+
+  // An empty node whose elements will start at slot index.
+  // Strong guarantees
+  UnrolledListNodeBase* CreateNode(const size_t index) {
+    Node* const node = NodesTraits::allocate(GetAllocator(), 1);
+    NodesTraits::construct(GetAllocator(), node);
+    node->begin = node->end = static_cast<unsigned>(index);
+    return node;
+  }
+
+  // Links node before position.
+  static UnrolledListNodeBase* LinkNode(UnrolledListNodeBase* const node,
+                                        UnrolledListNodeBase* const position) {
+    node->next = position;
+    node->prev = position->prev;
+    position->prev->next = node;
+    position->prev = node;
+    return node;
+  }
+
+  // Unlinks and frees node, its elements must be destroyed already.
+  void DestroyNode(UnrolledListNodeBase* const node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    NodesTraits::destroy(GetAllocator(), static_cast<Node*>(node));
+    NodesTraits::deallocate(GetAllocator(), static_cast<Node*>(node), 1);
+  }
+
+  // Moves the back half of the full node to a new node after it, into slots
+  // from 0 on, and returns the new node.
+  UnrolledListNodeBase* SplitNode(UnrolledListNodeBase* const node) {
+    UnrolledListNodeBase* const next = LinkNode(CreateNode(0), node->next);
+    const size_t middle = node->begin + (node->end - node->begin + 1) / 2;
+    try {
+      for (size_t i = middle; i != node->end; ++i) {
+        Construct(next, next->end, std::move(*Slot(node, i)));
+        ++next->end;
+      }
+    } catch (...) {
+      for (size_t i = next->begin; i != next->end; ++i) {
+        Destroy(next, i);
+      }
+      DestroyNode(next);
+      throw;
+    }
+    for (size_t i = middle; i != node->end; ++i) {
+      Destroy(node, i);
+    }
+    node->end = static_cast<unsigned>(middle);
+    return next;
+  }
+
+  void SwapNodes(TUnrolledList& x) {
+    std::swap(base_.next, x.base_.next);
+    std::swap(base_.prev, x.base_.prev);
+    std::swap(size_, x.size_);
+    Relink(*this);
+    Relink(x);
+  }
+
+  // Points the ends of the nodes of list at its own base_.
+  static void Relink(TUnrolledList& list) {
+    if (list.size_ == 0) {
+      list.base_.next = list.base_.prev = &list.base_;
+    } else {
+      list.base_.next->prev = &list.base_;
+      list.base_.prev->next = &list.base_;
+    }
+  }
+
+  void SwapAllocators(TUnrolledList& x, std::true_type) {
+    using std::swap;
+    swap(GetAllocator(), x.GetAllocator());
+  }
+
+  void SwapAllocators(TUnrolledList&, std::false_type) {
+  }
+
+  void CopyAllocator(const NodesAllocator& allocator, std::true_type) {
+    GetAllocator() = allocator;
+  }
+
+  void CopyAllocator(const NodesAllocator&, std::false_type) {
+  }
+
+  void MoveAllocator(NodesAllocator& allocator, std::true_type) {
+    GetAllocator() = std::move(allocator);
+  }
+
+  void MoveAllocator(NodesAllocator&, std::false_type) {
+  }
+
+  UnrolledListNodeBase base_;
+  size_t size_ = 0;
+};
+
+#endif /* UNROLLED_LIST_H_ */